@@ -0,0 +1,22 @@
+/**
+ * @file crc16.h
+ * @author Walt
+ * @brief table-driven CRC-16/CCITT
+ * @version 0.1
+ * @date 2025-10-22
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef __CRC16_H__
+#define __CRC16_H__
+
+#include <stdint.h>
+
+#define CRC16_INIT 0xFFFF
+
+// Feed len bytes into a running CRC (start from CRC16_INIT)
+uint16_t crc16_update(uint16_t crc, const uint8_t *data, uint16_t len);
+
+#endif
@@ -2,13 +2,21 @@
 #include <xc.h>
 #include <libpic30.h>
 
-#define EEPROM_WRITE_CYCLE_MS 10
+const eeprom_device_t EEPROM_DEV_24C02 = {
+    EEPROM_24C02_ADDR_BYTES, EEPROM_24C02_WRITE_CYCLE_MS, EEPROM_24C02_PAGE_SIZE, EEPROM_24C02_CAPACITY};
+const eeprom_device_t EEPROM_DEV_24C32 = {
+    EEPROM_24C32_ADDR_BYTES, EEPROM_24C32_WRITE_CYCLE_MS, EEPROM_24C32_PAGE_SIZE, EEPROM_24C32_CAPACITY};
+const eeprom_device_t EEPROM_DEV_24C256 = {
+    EEPROM_24C256_ADDR_BYTES, EEPROM_24C256_WRITE_CYCLE_MS, EEPROM_24C256_PAGE_SIZE, EEPROM_24C256_CAPACITY};
 
 // --- Internal helper: poll device for ACK after write cycle ---
+// Polls at 1 ms intervals for up to twice the part's tWR instead of sitting
+// out a fixed delay first; most writes finish well inside the datasheet max.
 static bool eeprom_wait_ready(eeprom_t *e)
 {
     const i2c_t *bus = e->bus;
-    for (uint8_t i = 0; i < 20; ++i)
+    uint8_t tries = (uint8_t)(eeprom_dev_write_cycle_ms(e->dev) * 2u);
+    for (uint8_t i = 0; i < tries; ++i)
     {
         if (i2c_start(bus) != I2C_OK)
         {
@@ -28,29 +36,97 @@ static bool eeprom_wait_ready(eeprom_t *e)
     return false;
 }
 
+// --- Internal helper: send the 1- or 2-byte memory address ---
+static i2c_result_t eeprom_write_mem_addr(const eeprom_t *e, uint16_t mem_addr)
+{
+    if (eeprom_dev_addr_bytes(e->dev) == 2)
+    {
+        i2c_result_t res = i2c_write_byte(e->bus, (uint8_t)(mem_addr >> 8));
+        if (res != I2C_OK)
+        {
+            return res;
+        }
+    }
+    return i2c_write_byte(e->bus, (uint8_t)mem_addr);
+}
+
+// --- Internal helper: START, address phase and RESTART into read mode ---
+// If the device's address pointer is already at mem_addr (e.g. right after
+// reading the span before it) the address phase is skipped and a
+// current-address read is issued instead: 3-4 fewer bytes on the bus.
+static eeprom_result_t eeprom_begin_read(eeprom_t *e, uint16_t mem_addr)
+{
+    const i2c_t *bus = e->bus;
+    bool current = e->addr_known && (e->next_addr == mem_addr);
+    e->addr_known = false; // re-armed by eeprom_end_read on success
+
+    if (i2c_start(bus) != I2C_OK)
+    {
+        return EEPROM_ERR_TIMEOUT;
+    }
+    if (!current &&
+        (i2c_write_byte(bus, (e->address << 1) | 0) != I2C_OK ||
+         eeprom_write_mem_addr(e, mem_addr) != I2C_OK ||
+         i2c_restart(bus) != I2C_OK))
+    {
+        i2c_stop(bus);
+        return EEPROM_ERR_I2C;
+    }
+    if (i2c_write_byte(bus, (e->address << 1) | 1) != I2C_OK)
+    {
+        i2c_stop(bus);
+        return EEPROM_ERR_I2C;
+    }
+    return EEPROM_OK;
+}
+
+// --- Internal helper: STOP and remember where the address pointer ended ---
+static void eeprom_end_read(eeprom_t *e, uint16_t mem_addr, uint32_t len)
+{
+    i2c_stop(e->bus);
+    e->next_addr = (uint16_t)((mem_addr + len) & (eeprom_dev_capacity(e->dev) - 1));
+    e->addr_known = true;
+}
+
 // --- Public API ---
 void eeprom_init(eeprom_t *e, i2c_t *bus, uint8_t address)
+{
+    eeprom_init_device(e, bus, address, &EEPROM_DEV_24C02);
+}
+
+void eeprom_init_device(eeprom_t *e, i2c_t *bus, uint8_t address, const eeprom_device_t *dev)
 {
     e->bus = bus;
+    e->dev = dev;
     e->address = address & 0x7F;
+    e->addr_known = false;
     e->init = true;
 }
 
 void eeprom_deinit(eeprom_t *e)
 {
     e->init = false;
+    e->addr_known = false;
     e->bus = NULL;
 }
 
+void eeprom_forget_addr(eeprom_t *e)
+{
+    e->addr_known = false;
+}
+
 // ------------------------------------------------------------
 // Write one byte to EEPROM
 // ------------------------------------------------------------
-eeprom_result_t eeprom_write_byte(eeprom_t *e, uint8_t mem_addr, uint8_t data)
+eeprom_result_t eeprom_write_byte(eeprom_t *e, uint16_t mem_addr, uint8_t data)
 {
     if (!e || !e->init)
         return EEPROM_ERR_I2C;
+    if (!eeprom_dev_in_range(e->dev, mem_addr, 1))
+        return EEPROM_ERR_RANGE;
 
     const i2c_t *bus = e->bus;
+    e->addr_known = false; // pointer after a write cycle is not relied upon
     if (i2c_start(bus) != I2C_OK)
     {
         return EEPROM_ERR_TIMEOUT;
@@ -59,7 +135,7 @@ eeprom_result_t eeprom_write_byte(eeprom_t *e, uint8_t mem_addr, uint8_t data)
     {
         goto fail;
     }
-    if (i2c_write_byte(bus, mem_addr) != I2C_OK)
+    if (eeprom_write_mem_addr(e, mem_addr) != I2C_OK)
     {
         goto fail;
     }
@@ -69,7 +145,6 @@ eeprom_result_t eeprom_write_byte(eeprom_t *e, uint8_t mem_addr, uint8_t data)
     }
     i2c_stop(bus);
 
-    __delay_ms(EEPROM_WRITE_CYCLE_MS);
     if (!eeprom_wait_ready(e))
     {
         return EEPROM_ERR_TIMEOUT;
@@ -84,38 +159,25 @@ fail:
 // ------------------------------------------------------------
 // Read one byte from EEPROM
 // ------------------------------------------------------------
-eeprom_result_t eeprom_read_byte(eeprom_t *e, uint8_t mem_addr, uint8_t *data)
+eeprom_result_t eeprom_read_byte(eeprom_t *e, uint16_t mem_addr, uint8_t *data)
 {
     if (!e || !e->init || !data)
         return EEPROM_ERR_I2C;
+    if (!eeprom_dev_in_range(e->dev, mem_addr, 1))
+        return EEPROM_ERR_RANGE;
 
     const i2c_t *bus = e->bus;
 
-    if (i2c_start(bus) != I2C_OK)
-    {
-        return EEPROM_ERR_TIMEOUT;
-    }
-    if (i2c_write_byte(bus, (e->address << 1) | 0) != I2C_OK)
-    {
-        goto fail;
-    }
-    if (i2c_write_byte(bus, mem_addr) != I2C_OK)
-    {
-        goto fail;
-    }
-    if (i2c_restart(bus) != I2C_OK)
+    eeprom_result_t res = eeprom_begin_read(e, mem_addr);
+    if (res != EEPROM_OK)
     {
-        goto fail;
-    }
-    if (i2c_write_byte(bus, (e->address << 1) | 1) != I2C_OK)
-    {
-        goto fail;
+        return res;
     }
     if (i2c_read_byte(bus, data, false) != I2C_OK)
     {
         goto fail;
     }
-    i2c_stop(bus);
+    eeprom_end_read(e, mem_addr, 1);
     return EEPROM_OK;
 
 fail:
@@ -126,34 +188,21 @@ fail:
 // ------------------------------------------------------------
 // Block read
 // ------------------------------------------------------------
-eeprom_result_t eeprom_read_block(eeprom_t *e, uint8_t start_addr, uint8_t *buf, uint8_t len)
+eeprom_result_t eeprom_read_block(eeprom_t *e, uint16_t start_addr, uint8_t *buf, uint16_t len)
 {
     if (!e || !buf || !len)
         return EEPROM_ERR_I2C;
+    if (!eeprom_dev_in_range(e->dev, start_addr, len))
+        return EEPROM_ERR_RANGE;
     const i2c_t *bus = e->bus;
 
-    if (i2c_start(bus) != I2C_OK)
-    {
-        return EEPROM_ERR_TIMEOUT;
-    }
-    if (i2c_write_byte(bus, (e->address << 1) | 0) != I2C_OK)
+    eeprom_result_t res = eeprom_begin_read(e, start_addr);
+    if (res != EEPROM_OK)
     {
-        goto fail;
-    }
-    if (i2c_write_byte(bus, start_addr) != I2C_OK)
-    {
-        goto fail;
-    }
-    if (i2c_restart(bus) != I2C_OK)
-    {
-        goto fail;
-    }
-    if (i2c_write_byte(bus, (e->address << 1) | 1) != I2C_OK)
-    {
-        goto fail;
+        return res;
     }
 
-    for (uint8_t i = 0; i < len; i++)
+    for (uint16_t i = 0; i < len; i++)
     {
         bool ack = (i < len - 1);
         if (i2c_read_byte(bus, &buf[i], ack) != I2C_OK)
@@ -161,7 +210,50 @@ eeprom_result_t eeprom_read_block(eeprom_t *e, uint8_t start_addr, uint8_t *buf,
             goto fail;
         }
     }
+    eeprom_end_read(e, start_addr, len);
+    return EEPROM_OK;
+
+fail:
     i2c_stop(bus);
+    return EEPROM_ERR_I2C;
+}
+
+// ------------------------------------------------------------
+// Streaming read: one address phase, then sequential reads handed to cb
+// in EEPROM_STREAM_CHUNK pieces. The chunk is only valid during cb.
+// ------------------------------------------------------------
+eeprom_result_t eeprom_read_stream(eeprom_t *e, uint16_t start_addr, uint32_t len,
+                                   eeprom_chunk_cb_t cb, void *ctx)
+{
+    if (!e || !cb || !len)
+        return EEPROM_ERR_I2C;
+    if ((uint32_t)start_addr + len > eeprom_dev_capacity(e->dev))
+        return EEPROM_ERR_RANGE;
+    const i2c_t *bus = e->bus;
+
+    eeprom_result_t res = eeprom_begin_read(e, start_addr);
+    if (res != EEPROM_OK)
+    {
+        return res;
+    }
+
+    uint8_t chunk[EEPROM_STREAM_CHUNK];
+    const uint32_t total = len;
+    while (len)
+    {
+        uint8_t n = (len > EEPROM_STREAM_CHUNK) ? EEPROM_STREAM_CHUNK : (uint8_t)len;
+        len -= n;
+        for (uint8_t i = 0; i < n; i++)
+        {
+            bool ack = (len != 0) || (i < n - 1);
+            if (i2c_read_byte(bus, &chunk[i], ack) != I2C_OK)
+            {
+                goto fail;
+            }
+        }
+        cb(ctx, chunk, n); // SCL is held low while the consumer runs
+    }
+    eeprom_end_read(e, start_addr, total);
     return EEPROM_OK;
 
 fail:
@@ -170,24 +262,30 @@ fail:
 }
 
 // ------------------------------------------------------------
-// Block write (page writes up to 8 bytes for M24C02)
+// Block write (one write cycle per device page)
 // ------------------------------------------------------------
-eeprom_result_t eeprom_write_block(eeprom_t *e, uint8_t start_addr, const uint8_t *buf, uint8_t len)
+eeprom_result_t eeprom_write_block(eeprom_t *e, uint16_t start_addr, const uint8_t *buf, uint16_t len)
 {
     if (!e || !buf || !len)
     {
         return EEPROM_ERR_I2C;
     }
+    if (!eeprom_dev_in_range(e->dev, start_addr, len))
+    {
+        return EEPROM_ERR_RANGE;
+    }
     const i2c_t *bus = e->bus;
+    const uint16_t page_size = eeprom_dev_page_size(e->dev);
+    e->addr_known = false; // pointer after a write cycle is not relied upon
 
-    uint8_t remaining = len;
-    uint8_t addr = start_addr;
+    uint16_t remaining = len;
+    uint16_t addr = start_addr;
     const uint8_t *p = buf;
 
     while (remaining > 0)
     {
-        uint8_t page_offset = addr & 0x07;
-        uint8_t bytes_in_page = 8 - page_offset;
+        uint16_t page_offset = addr & (page_size - 1);
+        uint16_t bytes_in_page = page_size - page_offset;
         if (bytes_in_page > remaining)
         {
             bytes_in_page = remaining;
@@ -201,12 +299,12 @@ eeprom_result_t eeprom_write_block(eeprom_t *e, uint8_t start_addr, const uint8_
         {
             goto fail;
         }
-        if (i2c_write_byte(bus, addr) != I2C_OK)
+        if (eeprom_write_mem_addr(e, addr) != I2C_OK)
         {
             goto fail;
         }
 
-        for (uint8_t i = 0; i < bytes_in_page; i++)
+        for (uint16_t i = 0; i < bytes_in_page; i++)
         {
             if (i2c_write_byte(bus, *p++) != I2C_OK)
             {
@@ -214,7 +312,6 @@ eeprom_result_t eeprom_write_block(eeprom_t *e, uint8_t start_addr, const uint8_
             }
         }
         i2c_stop(bus);
-        __delay_ms(EEPROM_WRITE_CYCLE_MS);
         if (!eeprom_wait_ready(e))
         {
             return EEPROM_ERR_TIMEOUT;
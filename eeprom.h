@@ -24,26 +24,146 @@ typedef enum
     EEPROM_OK = 0,
     EEPROM_ERR_I2C,
     EEPROM_ERR_TIMEOUT,
-    EEPROM_ERR_NACK
+    EEPROM_ERR_NACK,
+    EEPROM_ERR_RANGE
 } eeprom_result_t;
 
+/**
+ * Device geometry. Page size must be a power of two; two-byte memory
+ * addresses are sent MSB first.
+ *
+ *  Part     Addr bytes  Page  Capacity  tWR
+ *  24C02    1           8     256       10 ms (M24C02, kept conservative)
+ *  24C32    2           32    4096      5 ms
+ *  24C256   2           64    32768     5 ms
+ */
+#define EEPROM_24C02_ADDR_BYTES 1
+#define EEPROM_24C02_PAGE_SIZE 8
+#define EEPROM_24C02_CAPACITY 256UL
+#define EEPROM_24C02_WRITE_CYCLE_MS 10
+
+#define EEPROM_24C32_ADDR_BYTES 2
+#define EEPROM_24C32_PAGE_SIZE 32
+#define EEPROM_24C32_CAPACITY 4096UL
+#define EEPROM_24C32_WRITE_CYCLE_MS 5
+
+#define EEPROM_24C256_ADDR_BYTES 2
+#define EEPROM_24C256_PAGE_SIZE 64
+#define EEPROM_24C256_CAPACITY 32768UL
+#define EEPROM_24C256_WRITE_CYCLE_MS 5
+
+typedef struct
+{
+    uint8_t addr_bytes;     // memory address width (1 or 2)
+    uint8_t write_cycle_ms; // worst-case internal write time
+    uint16_t page_size;     // page write buffer size
+    uint32_t capacity;      // total size in bytes
+} eeprom_device_t;
+
+extern const eeprom_device_t EEPROM_DEV_24C02;
+extern const eeprom_device_t EEPROM_DEV_24C32;
+extern const eeprom_device_t EEPROM_DEV_24C256;
+
+/**
+ * Build with -DEEPROM_FIXED_24C02 (or _24C32 / _24C256) when every EEPROM on
+ * the board is the same part. The geometry accessors below then fold to
+ * constants and the per-device descriptor is never dereferenced.
+ */
+#if defined(EEPROM_FIXED_24C02)
+#define EEPROM_FIXED_ADDR_BYTES EEPROM_24C02_ADDR_BYTES
+#define EEPROM_FIXED_PAGE_SIZE EEPROM_24C02_PAGE_SIZE
+#define EEPROM_FIXED_CAPACITY EEPROM_24C02_CAPACITY
+#define EEPROM_FIXED_WRITE_CYCLE_MS EEPROM_24C02_WRITE_CYCLE_MS
+#elif defined(EEPROM_FIXED_24C32)
+#define EEPROM_FIXED_ADDR_BYTES EEPROM_24C32_ADDR_BYTES
+#define EEPROM_FIXED_PAGE_SIZE EEPROM_24C32_PAGE_SIZE
+#define EEPROM_FIXED_CAPACITY EEPROM_24C32_CAPACITY
+#define EEPROM_FIXED_WRITE_CYCLE_MS EEPROM_24C32_WRITE_CYCLE_MS
+#elif defined(EEPROM_FIXED_24C256)
+#define EEPROM_FIXED_ADDR_BYTES EEPROM_24C256_ADDR_BYTES
+#define EEPROM_FIXED_PAGE_SIZE EEPROM_24C256_PAGE_SIZE
+#define EEPROM_FIXED_CAPACITY EEPROM_24C256_CAPACITY
+#define EEPROM_FIXED_WRITE_CYCLE_MS EEPROM_24C256_WRITE_CYCLE_MS
+#endif
+
+// Streaming read consumer; chunk holds len (<= EEPROM_STREAM_CHUNK) bytes
+#define EEPROM_STREAM_CHUNK 16
+typedef void (*eeprom_chunk_cb_t)(void *ctx, const uint8_t *chunk, uint8_t len);
+
 typedef struct
 {
     bool init;
+    const eeprom_device_t *dev; // geometry (ignored when EEPROM_FIXED_*)
     uint8_t address; // 7-bit IC address (e.g., 0x50?0x57)
     i2c_t *bus;      // pointer to IC bus object
+    uint16_t next_addr; // device address pointer, valid while addr_known
+    bool addr_known;    // cleared by writes, errors and eeprom_forget_addr
 } eeprom_t;
 
+// --- Geometry accessors (constant-folded under EEPROM_FIXED_*) ---
+static inline uint8_t eeprom_dev_addr_bytes(const eeprom_device_t *d)
+{
+#ifdef EEPROM_FIXED_ADDR_BYTES
+    (void)d;
+    return EEPROM_FIXED_ADDR_BYTES;
+#else
+    return d->addr_bytes;
+#endif
+}
+
+static inline uint16_t eeprom_dev_page_size(const eeprom_device_t *d)
+{
+#ifdef EEPROM_FIXED_PAGE_SIZE
+    (void)d;
+    return EEPROM_FIXED_PAGE_SIZE;
+#else
+    return d->page_size;
+#endif
+}
+
+static inline uint32_t eeprom_dev_capacity(const eeprom_device_t *d)
+{
+#ifdef EEPROM_FIXED_CAPACITY
+    (void)d;
+    return EEPROM_FIXED_CAPACITY;
+#else
+    return d->capacity;
+#endif
+}
+
+static inline uint8_t eeprom_dev_write_cycle_ms(const eeprom_device_t *d)
+{
+#ifdef EEPROM_FIXED_WRITE_CYCLE_MS
+    (void)d;
+    return EEPROM_FIXED_WRITE_CYCLE_MS;
+#else
+    return d->write_cycle_ms;
+#endif
+}
+
+// True if [start, start + len) lies inside the device
+static inline bool eeprom_dev_in_range(const eeprom_device_t *d, uint16_t start, uint16_t len)
+{
+    return ((uint32_t)start + len) <= eeprom_dev_capacity(d);
+}
+
 // --- Initialization / teardown ---
-void eeprom_init(eeprom_t *e, i2c_t *bus, uint8_t address);
+void eeprom_init(eeprom_t *e, i2c_t *bus, uint8_t address); // 24C02
+void eeprom_init_device(eeprom_t *e, i2c_t *bus, uint8_t address, const eeprom_device_t *dev);
 void eeprom_deinit(eeprom_t *e);
+// Call when the part may have been swapped or power-cycled behind our back
+void eeprom_forget_addr(eeprom_t *e);
 
 // --- Read / write operations ---
-eeprom_result_t eeprom_write_byte(eeprom_t *e, uint8_t mem_addr, uint8_t data);
-eeprom_result_t eeprom_read_byte(eeprom_t *e, uint8_t mem_addr, uint8_t *data);
+eeprom_result_t eeprom_write_byte(eeprom_t *e, uint16_t mem_addr, uint8_t data);
+eeprom_result_t eeprom_read_byte(eeprom_t *e, uint16_t mem_addr, uint8_t *data);
 
 // Optional: block read/write
-eeprom_result_t eeprom_read_block(eeprom_t *e, uint8_t start_addr, uint8_t *buf, uint8_t len);
-eeprom_result_t eeprom_write_block(eeprom_t *e, uint8_t start_addr, const uint8_t *buf, uint8_t len);
+eeprom_result_t eeprom_read_block(eeprom_t *e, uint16_t start_addr, uint8_t *buf, uint16_t len);
+eeprom_result_t eeprom_write_block(eeprom_t *e, uint16_t start_addr, const uint8_t *buf, uint16_t len);
+
+// Sequential read of any length with a single address phase (full dumps)
+eeprom_result_t eeprom_read_stream(eeprom_t *e, uint16_t start_addr, uint32_t len,
+                                   eeprom_chunk_cb_t cb, void *ctx);
 
 #endif /* __EEPROM_H__ */
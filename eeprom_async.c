@@ -1,62 +1,389 @@
 #include "eeprom_async.h"
+#include <string.h>
 
-typedef struct
+static void eeproma_read_cb(void *context, i2c_event_t event);
+static void eeproma_probe_cb(void *context, i2c_event_t event);
+static void eeproma_write_chunk_done(void *context, i2c_event_t event);
+static void eeproma_write_poll_done(void *context, i2c_event_t event);
+static void eeproma_stream_done(void *context, i2c_event_t event);
+static uint8_t *eeproma_stream_next(void *context, uint8_t *len);
+
+static inline eeproma_result_t eeproma_result_from_event(i2c_event_t event)
 {
-    eeproma_t *e;
-    uint8_t *buf;
-    uint8_t len;
-    eeproma_callback_t cb;
-    void *ctx;
-} eeproma_ctx_t;
+    if (event == I2C_EVENT_COMPLETE)
+    {
+        return EEPROMA_OK;
+    }
+    return (event == I2C_EVENT_NACK) ? EEPROMA_ERR_NACK : EEPROMA_ERR_TIMEOUT;
+}
 
-static void eeproma_read_cb(void *context, i2c_event_t event);
+static inline uint8_t eeproma_put_addr(const eeproma_t *e, uint8_t *tx, uint16_t addr)
+{
+    if (eeprom_dev_addr_bytes(e->dev) == 2)
+    {
+        tx[0] = (uint8_t)(addr >> 8);
+        tx[1] = (uint8_t)addr;
+        return 2;
+    }
+    tx[0] = (uint8_t)addr;
+    return 1;
+}
+
+// ------------------------------------------------------------
+// Context pool: one slot per outstanding request on this device
+// ------------------------------------------------------------
+static eeproma_ctx_t *eeproma_ctx_alloc(eeproma_t *e)
+{
+    eeproma_ctx_t *c = NULL;
+    uint16_t ipl;
+
+    // Submitted from both the main loop and ISRs; claim the slot atomically
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    for (uint8_t i = 0; i < EEPROMA_MAX_PENDING; i++)
+    {
+        if (!e->pool[i].busy)
+        {
+            c = &e->pool[i];
+            c->busy = true;
+            break;
+        }
+    }
+    RESTORE_CPU_IPL(ipl);
+    return c;
+}
+
+// ------------------------------------------------------------
+// Address pointer tracking. A read may skip the memory address phase
+// (current-address read) when nothing else is queued for the device and
+// its pointer is known to sit at start_addr already.
+// ------------------------------------------------------------
+static bool eeproma_begin(eeproma_t *e, uint16_t start_addr)
+{
+    uint16_t ipl;
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    bool current = !e->inflight && e->addr_known && (e->next_addr == start_addr);
+    e->addr_known = false;
+    e->inflight++;
+    RESTORE_CPU_IPL(ipl);
+    return current;
+}
+
+static void eeproma_abort(eeproma_t *e)
+{
+    uint16_t ipl;
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    e->inflight--;
+    RESTORE_CPU_IPL(ipl);
+}
+
+// ISR context. Only a completed read re-arms the pointer.
+static void eeproma_end(eeproma_t *e, uint16_t end_addr, bool arm)
+{
+    e->inflight--;
+    if (arm && !e->inflight)
+    {
+        e->next_addr = end_addr;
+        e->addr_known = true;
+    }
+}
+
+static inline uint16_t eeproma_end_addr(const eeproma_t *e, uint16_t start_addr, uint32_t len)
+{
+    return (uint16_t)((start_addr + len) & (eeprom_dev_capacity(e->dev) - 1));
+}
 
-bool eeproma_read_block_async(eeproma_t *e, uint8_t start_addr, uint8_t *buf, uint8_t len,
+bool eeproma_read_block_async(eeproma_t *e, uint16_t start_addr, uint8_t *buf, uint8_t len,
                               eeproma_callback_t cb, void *ctx)
 {
     if (!e || !e->init || !len)
     {
         return false;
     }
+    if (!eeprom_dev_in_range(e->dev, start_addr, len))
+    {
+        return false;
+    }
 
-    static uint8_t tx[1];
-    tx[0] = start_addr;
-
-    static eeproma_ctx_t c;
-    c.e = e;
-    c.buf = buf;
-    c.len = len;
-    c.cb = cb;
-    c.ctx = ctx;
+    eeproma_ctx_t *c = eeproma_ctx_alloc(e);
+    if (!c)
+    {
+        return false;
+    }
+    c->cb = cb;
+    c->ctx = ctx;
+    c->owner = e;
+    c->end_addr = eeproma_end_addr(e, start_addr, len);
 
+    uint8_t tx_len = eeproma_begin(e, start_addr) ? 0 : eeproma_put_addr(e, c->tx, start_addr);
     i2c_transaction_t t = {
-        .address = e->address, .tx_buf = tx, .tx_len = 1, .rx_buf = buf, .rx_len = len, .cb = eeproma_read_cb, .context = &c};
-    return i2c_async_submit(e->i2c, &t);
+        .address = e->address, .tx_buf = c->tx, .tx_len = tx_len, .rx_buf = buf, .rx_len = len, .cb = eeproma_read_cb, .context = c};
+    if (!i2c_async_submit(e->i2c, &t))
+    {
+        eeproma_abort(e);
+        c->busy = false;
+        return false;
+    }
+    return true;
 }
 
 static void eeproma_read_cb(void *context, i2c_event_t event)
 {
     eeproma_ctx_t *c = (eeproma_ctx_t *)context;
-    if (c->cb)
+    eeproma_callback_t cb = c->cb;
+    void *ctx = c->ctx;
+
+    eeproma_end((eeproma_t *)c->owner, c->end_addr, event == I2C_EVENT_COMPLETE);
+    c->busy = false; // free before the callback so it can resubmit
+    if (cb)
     {
-        if (event == I2C_EVENT_COMPLETE)
-        {
-            c->cb(c->ctx, EEPROMA_OK);
-        }
-        else if (event == I2C_EVENT_NACK)
-        {
-            c->cb(c->ctx, EEPROMA_ERR_NACK);
-        }
-        else
-        {
-            c->cb(c->ctx, EEPROMA_ERR_TIMEOUT);
-        }
+        cb(ctx, eeproma_result_from_event(event));
+    }
+}
+
+// ------------------------------------------------------------
+// Presence probe: START, address, STOP. Leaves the address pointer alone.
+// ------------------------------------------------------------
+bool eeproma_probe_async(eeproma_t *e, eeproma_callback_t cb, void *ctx)
+{
+    if (!e || !e->init)
+    {
+        return false;
+    }
+    eeproma_ctx_t *c = eeproma_ctx_alloc(e);
+    if (!c)
+    {
+        return false;
+    }
+    c->cb = cb;
+    c->ctx = ctx;
+
+    i2c_transaction_t t = {.address = e->address, .cb = eeproma_probe_cb, .context = c};
+    if (!i2c_async_submit(e->i2c, &t))
+    {
+        c->busy = false;
+        return false;
+    }
+    return true;
+}
+
+static void eeproma_probe_cb(void *context, i2c_event_t event)
+{
+    eeproma_ctx_t *c = (eeproma_ctx_t *)context;
+    eeproma_callback_t cb = c->cb;
+    void *ctx = c->ctx;
+
+    c->busy = false;
+    if (cb)
+    {
+        cb(ctx, eeproma_result_from_event(event));
+    }
+}
+
+// ------------------------------------------------------------
+// Streaming read: one address phase, then chunks through a double buffer
+// ------------------------------------------------------------
+bool eeproma_read_stream_async(eeproma_t *e, eeproma_stream_t *s, uint16_t start_addr, uint32_t len,
+                               eeprom_chunk_cb_t chunk_cb, eeproma_callback_t done_cb, void *ctx)
+{
+    if (!e || !e->init || !s || !chunk_cb || !len)
+    {
+        return false;
+    }
+    if ((uint32_t)start_addr + len > eeprom_dev_capacity(e->dev))
+    {
+        return false;
+    }
+
+    s->fill = 0;
+    s->chunk_len = (len > EEPROM_STREAM_CHUNK) ? EEPROM_STREAM_CHUNK : (uint8_t)len;
+    s->remaining = len - s->chunk_len;
+    s->chunk_cb = chunk_cb;
+    s->done_cb = done_cb;
+    s->ctx = ctx;
+    s->owner = e;
+    s->end_addr = eeproma_end_addr(e, start_addr, len);
+
+    i2c_transaction_t t = {
+        .address = e->address,
+        .tx_buf = s->tx,
+        .tx_len = eeproma_begin(e, start_addr) ? 0 : eeproma_put_addr(e, s->tx, start_addr),
+        .rx_buf = s->buf[0],
+        .rx_len = s->chunk_len,
+        .rx_next = eeproma_stream_next,
+        .cb = eeproma_stream_done,
+        .context = s};
+    if (!i2c_async_submit(e->i2c, &t))
+    {
+        eeproma_abort(e);
+        return false;
+    }
+    return true;
+}
+
+// ISR context: hand off the full half, keep reading into the other one
+static uint8_t *eeproma_stream_next(void *context, uint8_t *len)
+{
+    eeproma_stream_t *s = (eeproma_stream_t *)context;
+    s->chunk_cb(s->ctx, s->buf[s->fill], s->chunk_len);
+    if (!s->remaining)
+    {
+        return NULL;
+    }
+
+    s->fill ^= 1;
+    s->chunk_len = (s->remaining > EEPROM_STREAM_CHUNK) ? EEPROM_STREAM_CHUNK : (uint8_t)s->remaining;
+    s->remaining -= s->chunk_len;
+    *len = s->chunk_len;
+    return s->buf[s->fill];
+}
+
+static void eeproma_stream_done(void *context, i2c_event_t event)
+{
+    eeproma_stream_t *s = (eeproma_stream_t *)context;
+    eeproma_end((eeproma_t *)s->owner, s->end_addr, event == I2C_EVENT_COMPLETE);
+    if (s->done_cb)
+    {
+        s->done_cb(s->ctx, eeproma_result_from_event(event));
     }
 }
 
 void eeproma_init(eeproma_t *e, i2c_async_t *bus, uint8_t addr)
 {
+    eeproma_init_device(e, bus, addr, &EEPROM_DEV_24C02);
+}
+
+void eeproma_init_device(eeproma_t *e, i2c_async_t *bus, uint8_t addr, const eeprom_device_t *dev)
+{
+    memset(e->pool, 0, sizeof(e->pool));
+    e->inflight = 0;
+    e->addr_known = false;
     e->address = addr & 0x7F;
+    e->dev = dev;
     e->i2c = bus;
     e->init = true;
 }
+
+void eeproma_forget_addr(eeproma_t *e)
+{
+    e->addr_known = false;
+}
+
+// ------------------------------------------------------------
+// Block write: one transaction per page chunk, then ACK polling through
+// the queue (other traffic interleaves) until the write cycle is over.
+// ------------------------------------------------------------
+static void eeproma_write_finish(eeproma_write_t *w, eeproma_result_t res)
+{
+    eeproma_end((eeproma_t *)w->owner, 0, false);
+    if (w->done_cb)
+    {
+        w->done_cb(w->ctx, res);
+    }
+}
+
+static bool eeproma_write_chunk(eeproma_write_t *w)
+{
+    eeproma_t *e = (eeproma_t *)w->owner;
+    const uint16_t page_size = eeprom_dev_page_size(e->dev);
+    uint16_t n = page_size - (w->addr & (page_size - 1));
+    if (n > EEPROMA_WRITE_CHUNK)
+    {
+        n = EEPROMA_WRITE_CHUNK;
+    }
+    if (n > w->remaining)
+    {
+        n = w->remaining;
+    }
+
+    uint8_t hdr = eeproma_put_addr(e, w->tx, w->addr);
+    memcpy(&w->tx[hdr], w->src, n);
+    w->chunk = (uint8_t)n;
+    w->polls = 0;
+
+    i2c_transaction_t t = {
+        .address = e->address, .tx_buf = w->tx, .tx_len = (uint8_t)(hdr + n), .cb = eeproma_write_chunk_done, .context = w};
+    return i2c_async_submit(e->i2c, &t);
+}
+
+static bool eeproma_write_poll(eeproma_write_t *w)
+{
+    eeproma_t *e = (eeproma_t *)w->owner;
+    i2c_transaction_t t = {.address = e->address, .cb = eeproma_write_poll_done, .context = w};
+    return i2c_async_submit(e->i2c, &t);
+}
+
+bool eeproma_write_block_async(eeproma_t *e, eeproma_write_t *w, uint16_t start_addr, const uint8_t *buf,
+                               uint16_t len, eeproma_callback_t cb, void *ctx)
+{
+    if (!e || !e->init || !w || !buf || !len)
+    {
+        return false;
+    }
+    if (!eeprom_dev_in_range(e->dev, start_addr, len))
+    {
+        return false;
+    }
+
+    w->owner = e;
+    w->src = buf;
+    w->addr = start_addr;
+    w->remaining = len;
+    w->done_cb = cb;
+    w->ctx = ctx;
+
+    eeproma_begin(e, start_addr); // writes only ever invalidate the pointer
+    if (!eeproma_write_chunk(w))
+    {
+        eeproma_abort(e);
+        return false;
+    }
+    return true;
+}
+
+static void eeproma_write_chunk_done(void *context, i2c_event_t event)
+{
+    eeproma_write_t *w = (eeproma_write_t *)context;
+    if (event != I2C_EVENT_COMPLETE)
+    {
+        eeproma_write_finish(w, eeproma_result_from_event(event));
+        return;
+    }
+    w->src += w->chunk;
+    w->addr += w->chunk;
+    w->remaining -= w->chunk;
+    if (!eeproma_write_poll(w))
+    {
+        eeproma_write_finish(w, EEPROMA_ERR_TIMEOUT);
+    }
+}
+
+static void eeproma_write_poll_done(void *context, i2c_event_t event)
+{
+    eeproma_write_t *w = (eeproma_write_t *)context;
+    bool ok;
+
+    if (event != I2C_EVENT_COMPLETE)
+    {
+        // Still busy with the internal write cycle
+        if (++w->polls >= EEPROMA_WRITE_POLLS)
+        {
+            eeproma_write_finish(w, EEPROMA_ERR_TIMEOUT);
+            return;
+        }
+        ok = eeproma_write_poll(w);
+    }
+    else if (w->remaining)
+    {
+        ok = eeproma_write_chunk(w);
+    }
+    else
+    {
+        eeproma_write_finish(w, EEPROMA_OK);
+        return;
+    }
+
+    if (!ok)
+    {
+        eeproma_write_finish(w, EEPROMA_ERR_TIMEOUT);
+    }
+}
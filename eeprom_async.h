@@ -17,6 +17,7 @@
 #include <xc.h>
 #include <libpic30.h>
 #include "i2c_async.h"
+#include "eeprom.h"
 
 typedef enum
 {
@@ -27,15 +28,82 @@ typedef enum
 
 typedef void (*eeproma_callback_t)(void *ctx, eeproma_result_t res);
 
+// Requests one device can have queued at once (each owns a context slot)
+#define EEPROMA_MAX_PENDING 2
+
+typedef struct
+{
+    volatile bool busy;
+    uint8_t tx[2];     // memory address bytes, must live until the transfer ends
+    uint16_t end_addr; // device address pointer once this read completes
+    void *owner;       // eeproma_t this slot belongs to
+    eeproma_callback_t cb;
+    void *ctx;
+} eeproma_ctx_t;
+
 typedef struct
 {
     bool init;
     uint8_t address;
+    const eeprom_device_t *dev; // geometry (ignored when EEPROM_FIXED_*)
     i2c_async_t *i2c;
+    eeproma_ctx_t pool[EEPROMA_MAX_PENDING];
+    volatile uint8_t inflight;  // submitted, not yet completed
+    volatile uint16_t next_addr; // device address pointer, valid while addr_known
+    volatile bool addr_known;    // only set when nothing is in flight
 } eeproma_t;
 
-void eeproma_init(eeproma_t *e, i2c_async_t *bus, uint8_t addr);
-bool eeproma_read_block_async(eeproma_t *e, uint8_t start_addr, uint8_t *buf, uint8_t len,
+/**
+ * Streaming read state (caller owned, must outlive the transfer). The ISR
+ * fills one half of buf while the chunk just handed to chunk_cb sits in the
+ * other, so a chunk stays valid until the next chunk_cb call.
+ */
+typedef struct
+{
+    uint8_t buf[2][EEPROM_STREAM_CHUNK];
+    uint8_t fill;       // half the ISR is filling
+    uint8_t chunk_len;  // bytes expected in that half
+    uint32_t remaining; // bytes not yet assigned to a half
+    uint8_t tx[2];
+    uint16_t end_addr;
+    void *owner;
+    eeprom_chunk_cb_t chunk_cb;
+    eeproma_callback_t done_cb;
+    void *ctx;
+} eeproma_stream_t;
+
+// Largest chunk per write transaction (split further at page boundaries)
+#define EEPROMA_WRITE_CHUNK 16
+// ACK polls allowed per write cycle (~100 us each at 100 kHz)
+#define EEPROMA_WRITE_POLLS 200
+
+/**
+ * Block write state (caller owned). buf must stay untouched until the
+ * callback, which runs once from the I2C ISR after the last write cycle.
+ */
+typedef struct
+{
+    uint8_t tx[2 + EEPROMA_WRITE_CHUNK]; // address bytes + chunk data
+    const uint8_t *src;
+    uint16_t addr;
+    uint16_t remaining;
+    uint8_t chunk; // bytes in the transaction on the bus
+    uint8_t polls;
+    void *owner;
+    eeproma_callback_t done_cb;
+    void *ctx;
+} eeproma_write_t;
+
+void eeproma_init(eeproma_t *e, i2c_async_t *bus, uint8_t addr); // 24C02
+void eeproma_init_device(eeproma_t *e, i2c_async_t *bus, uint8_t addr, const eeprom_device_t *dev);
+// Call when the part may have been swapped or power-cycled behind our back
+void eeproma_forget_addr(eeproma_t *e);
+bool eeproma_read_block_async(eeproma_t *e, uint16_t start_addr, uint8_t *buf, uint8_t len,
                               eeproma_callback_t cb, void *ctx);
+bool eeproma_write_block_async(eeproma_t *e, eeproma_write_t *w, uint16_t start_addr, const uint8_t *buf,
+                               uint16_t len, eeproma_callback_t cb, void *ctx);
+bool eeproma_probe_async(eeproma_t *e, eeproma_callback_t cb, void *ctx); // address-only ACK check
+bool eeproma_read_stream_async(eeproma_t *e, eeproma_stream_t *s, uint16_t start_addr, uint32_t len,
+                               eeprom_chunk_cb_t chunk_cb, eeproma_callback_t done_cb, void *ctx);
 
 #endif
@@ -0,0 +1,127 @@
+#include "eeprom_journal.h"
+#include <string.h>
+
+bool eeprom_journal_init(eeprom_journal_t *j, uint8_t *image, uint16_t base, uint16_t size, uint16_t page_size,
+                         uint8_t max_updates, uint16_t max_age_ms)
+{
+    memset(j, 0, sizeof(*j));
+    if (!image || !page_size || base % page_size || size > page_size * EEPROM_JOURNAL_PAGES_MAX)
+    {
+        return false;
+    }
+    j->image = image;
+    j->base = base;
+    j->size = size;
+    j->page_size = page_size;
+    j->max_updates = max_updates ? max_updates : 1;
+    j->max_age_ms = max_age_ms;
+    return true;
+}
+
+// ------------------------------------------------------------
+// Merge an update into the image (no bus traffic)
+// ------------------------------------------------------------
+bool eeprom_journal_write(eeprom_journal_t *j, uint16_t now, uint16_t offset, const uint8_t *buf, uint16_t len)
+{
+    if (!j->image || !buf || offset > j->size || len > j->size - offset)
+    {
+        return false;
+    }
+    bool changed = false;
+
+    while (len)
+    {
+        uint16_t page = offset / j->page_size;
+        uint16_t n = (uint16_t)((page + 1u) * j->page_size - offset);
+        if (n > len)
+        {
+            n = len;
+        }
+        if (memcmp(&j->image[offset], buf, n) != 0)
+        {
+            memcpy(&j->image[offset], buf, n);
+            j->dirty |= (uint16_t)(1u << page);
+            changed = true;
+        }
+        offset += n;
+        buf += n;
+        len -= n;
+    }
+
+    if (changed)
+    {
+        if (!j->updates)
+        {
+            j->since = now;
+        }
+        if (j->updates < 0xFF)
+        {
+            j->updates++;
+        }
+    }
+    return true;
+}
+
+void eeprom_journal_request_flush(eeprom_journal_t *j)
+{
+    if (eeprom_journal_pending(j))
+    {
+        j->flush_req = true; // cleared once the journal is clean
+    }
+}
+
+bool eeprom_journal_due(const eeprom_journal_t *j, uint16_t now)
+{
+    if (!j->dirty || j->flight)
+    {
+        return false;
+    }
+    return j->flush_req || j->updates >= j->max_updates || (uint16_t)(now - j->since) >= j->max_age_ms;
+}
+
+bool eeprom_journal_pending(const eeprom_journal_t *j)
+{
+    return j->dirty || j->flight;
+}
+
+// ------------------------------------------------------------
+// Flush, one page per write cycle
+// ------------------------------------------------------------
+bool eeprom_journal_next(eeprom_journal_t *j, uint16_t *addr, const uint8_t **buf, uint16_t *len)
+{
+    if (!j->dirty || j->flight)
+    {
+        return false;
+    }
+    uint16_t page = 0;
+    while (!(j->dirty & (1u << page)))
+    {
+        page++;
+    }
+    uint16_t offset = page * j->page_size;
+
+    j->flight = (uint16_t)(1u << page);
+    j->dirty &= (uint16_t)~j->flight;
+    if (!j->dirty)
+    {
+        j->updates = 0; // anything merged from here on starts a new batch
+    }
+    *addr = j->base + offset;
+    *buf = &j->image[offset];
+    *len = (j->size - offset < j->page_size) ? (uint16_t)(j->size - offset) : j->page_size;
+    return true;
+}
+
+void eeprom_journal_done(eeprom_journal_t *j, bool ok)
+{
+    if (!ok)
+    {
+        j->dirty |= j->flight;
+        j->updates = j->max_updates;
+    }
+    j->flight = 0;
+    if (!j->dirty)
+    {
+        j->flush_req = false;
+    }
+}
@@ -0,0 +1,64 @@
+/**
+ * @file eeprom_journal.h
+ * @author Walt
+ * @brief write-combining journal for small EEPROM updates
+ * @version 0.1
+ * @date 2025-10-22
+ *
+ * @copyright Copyright (c) 2025
+ *
+ * Small updates (counters, usage stats) are merged into a RAM image of an
+ * EEPROM region and only mark the pages they change dirty. A flush writes
+ * each dirty page back once, one write cycle however many updates it
+ * carries. A flush is due once max_updates changes are pending, once the
+ * oldest of them has waited max_age_ms, or after
+ * eeprom_journal_request_flush (e.g. before power-down). Those two limits
+ * bound what a power loss can cost.
+ *
+ * The journal never touches the bus itself, so it never blocks. Its owner
+ * takes the next page from eeprom_journal_next, submits it with whatever
+ * (async) write it already sequences, and reports the result back through
+ * eeprom_journal_done. The image must stay untouched while a page is on
+ * the bus. Times are on the owner's 16-bit ms clock.
+ */
+
+#ifndef __EEPROM_JOURNAL_H__
+#define __EEPROM_JOURNAL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EEPROM_JOURNAL_PAGES_MAX 16 // pages one journal can track
+
+typedef struct
+{
+    uint8_t *image;      // RAM copy of the region (caller owned)
+    uint16_t base;       // device address of image[0], page aligned
+    uint16_t size;
+    uint16_t page_size;  // write unit: the device page or a divisor of it
+    uint16_t dirty;      // bit n: page n holds updates not yet written
+    uint16_t flight;     // bit of the page on the bus, 0 = none
+    uint8_t updates;     // changes merged since the journal was last clean
+    uint8_t max_updates; // flush once this many are pending
+    uint16_t since;      // clock at the oldest pending change
+    uint16_t max_age_ms; // flush once it is this old
+    bool flush_req;      // flush everything, whatever the limits say
+} eeprom_journal_t;
+
+// image already holds the region's device contents
+bool eeprom_journal_init(eeprom_journal_t *j, uint8_t *image, uint16_t base, uint16_t size, uint16_t page_size,
+                         uint8_t max_updates, uint16_t max_age_ms);
+// Merge an update at offset into the region; bytes that do not change mark
+// nothing dirty. False if it does not fit in the region.
+bool eeprom_journal_write(eeprom_journal_t *j, uint16_t now, uint16_t offset, const uint8_t *buf, uint16_t len);
+void eeprom_journal_request_flush(eeprom_journal_t *j);
+bool eeprom_journal_due(const eeprom_journal_t *j, uint16_t now);
+bool eeprom_journal_pending(const eeprom_journal_t *j); // dirty or on the bus
+
+// Next dirty page to write, now on the bus until eeprom_journal_done;
+// false if nothing is dirty or a page is already out
+bool eeprom_journal_next(eeprom_journal_t *j, uint16_t *addr, const uint8_t **buf, uint16_t *len);
+// A failed page is dirty again and due at once
+void eeprom_journal_done(eeprom_journal_t *j, bool ok);
+
+#endif
@@ -31,8 +31,13 @@ void i2c_async_init(i2c_async_t *bus, const i2c_regs_t *regs, uint16_t brg)
 
 bool i2c_async_submit(i2c_async_t *bus, const i2c_transaction_t *t)
 {
+    uint16_t ipl;
+
+    // Callers include the main loop, timer ISRs and completion callbacks
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
     if (queue_full(bus))
     {
+        RESTORE_CPU_IPL(ipl);
         return false;
     }
 
@@ -44,6 +49,7 @@ bool i2c_async_submit(i2c_async_t *bus, const i2c_transaction_t *t)
         bus->busy = true;
         start_next_transaction(bus);
     }
+    RESTORE_CPU_IPL(ipl);
     return true;
 }
 
@@ -61,12 +67,11 @@ static void start_next_transaction(i2c_async_t *bus)
     bus->tx_index = 0;
     bus->rx_index = 0;
     bus->state = I2C_STATE_START;
+    bus->result = I2C_EVENT_COMPLETE;
 
     const i2c_regs_t *r = bus->regs;
     *r->CONL |= (1u << 0); // SEN
 }
-static bool ACKBIT = false;
-static bool FROM_ADDR = false;
 // ---------- ISR ----------
 void __attribute__((interrupt, no_auto_psv)) _MI2C1Interrupt(void)
 {
@@ -87,27 +92,21 @@ void __attribute__((interrupt, no_auto_psv)) _MI2C1Interrupt(void)
         {
             break; // SEN still set
         }
+        // Write phase first if there is anything to send, else straight to read
         *r->TRN = (bus->current.address << 1) |
-                  (bus->current.rx_len ? 1 : 0);
+                  (bus->current.tx_len ? 0 : (bus->current.rx_len ? 1 : 0));
         bus->state = I2C_STATE_ADDR;
-        FROM_ADDR = false;
         break;
 
     case I2C_STATE_ADDR:
-        FROM_ADDR = true;
         if (*r->STAT & (1u << 15))
         {                          // ACKSTAT = 1 ? NACK
             *r->CONL |= (1u << 2); // Stop
-            ACKBIT = false;
+            bus->result = I2C_EVENT_NACK;
             bus->state = I2C_STATE_STOP;
-            if (bus->current.cb)
-            {
-                bus->current.cb(bus->current.context, I2C_EVENT_NACK);
-            }
             break;
         }
-        ACKBIT = true;
-        if (bus->current.tx_len)
+        if (bus->tx_index < bus->current.tx_len)
         {
             *r->TRN = bus->current.tx_buf[bus->tx_index++];
             bus->state = I2C_STATE_TX;
@@ -125,15 +124,11 @@ void __attribute__((interrupt, no_auto_psv)) _MI2C1Interrupt(void)
         break;
 
     case I2C_STATE_TX:
-        FROM_ADDR = false;
         if (*r->STAT & (1u << 15))
         { // NACK
             *r->CONL |= (1u << 2);
+            bus->result = I2C_EVENT_NACK;
             bus->state = I2C_STATE_STOP;
-            if (bus->current.cb)
-            {
-                // bus->current.cb(bus->current.context, I2C_EVENT_NACK);
-            }
             break;
         }
         if (bus->tx_index < bus->current.tx_len)
@@ -154,7 +149,6 @@ void __attribute__((interrupt, no_auto_psv)) _MI2C1Interrupt(void)
         break;
 
     case I2C_STATE_RESTART:
-        FROM_ADDR = false;
         if (*r->CONL & (1u << 1))
         {
             break;
@@ -164,22 +158,48 @@ void __attribute__((interrupt, no_auto_psv)) _MI2C1Interrupt(void)
         break;
 
     case I2C_STATE_RX:
-        FROM_ADDR = false;
         if (!(*r->STAT & (1u << 1)))
         {
             break; // RBF not set
         }
         bus->current.rx_buf[bus->rx_index++] = *r->RCV;
+        if (bus->rx_index >= bus->current.rx_len && bus->current.rx_next)
+        {
+            // Streaming read: swap in the next buffer without a new address phase
+            uint8_t len = 0;
+            uint8_t *next = bus->current.rx_next(bus->current.context, &len);
+            if (next && len)
+            {
+                bus->current.rx_buf = next;
+                bus->current.rx_len = len;
+                bus->rx_index = 0;
+            }
+        }
         if (bus->rx_index < bus->current.rx_len)
         {
             *r->CONL &= ~(1u << 5); // ACKDT=0
-            *r->CONL |= (1u << 4);  // ACKEN
-            *r->CONL |= (1u << 3);  // RCEN again
         }
         else
         {
             *r->CONL |= (1u << 5); // NACK
-            *r->CONL |= (1u << 4); // ACKEN
+        }
+        *r->CONL |= (1u << 4); // ACKEN
+        bus->state = I2C_STATE_ACK;
+        break;
+
+    case I2C_STATE_ACK:
+        // RCEN/PEN are ignored until the ACK sequence has finished
+        if (*r->CONL & (1u << 4))
+        {
+            break; // ACKEN still set
+        }
+        if (bus->rx_index < bus->current.rx_len)
+        {
+            *r->CONL |= (1u << 3); // RCEN again
+            bus->state = I2C_STATE_RX;
+        }
+        else
+        {
             *r->CONL |= (1u << 2); // Stop
             bus->state = I2C_STATE_STOP;
         }
@@ -191,14 +211,10 @@ void __attribute__((interrupt, no_auto_psv)) _MI2C1Interrupt(void)
             break; // PEN still set
         }
         bus->state = I2C_STATE_DONE;
-        if ((FROM_ADDR == false) || (ACKBIT == true))
+        if (bus->current.cb)
         {
-            if (bus->current.cb)
-            {
-                bus->current.cb(bus->current.context, I2C_EVENT_COMPLETE);
-            }
+            bus->current.cb(bus->current.context, bus->result);
         }
-        FROM_ADDR = false;
         start_next_transaction(bus);
         break;
 
@@ -29,6 +29,10 @@ typedef enum
 
 typedef void (*i2c_callback_t)(void *context, i2c_event_t event);
 
+// Optional streaming hook: called from the ISR when rx_buf is full. Return
+// the next buffer and set *len to keep the read going, or NULL to finish.
+typedef uint8_t *(*i2c_rx_next_t)(void *context, uint8_t *len);
+
 typedef struct
 {
     uint8_t address;
@@ -36,6 +40,7 @@ typedef struct
     uint8_t tx_len;
     uint8_t *rx_buf;
     uint8_t rx_len;
+    i2c_rx_next_t rx_next;
     i2c_callback_t cb;
     void *context;
 } i2c_transaction_t;
@@ -48,6 +53,7 @@ typedef enum
     I2C_STATE_TX,
     I2C_STATE_RESTART,
     I2C_STATE_RX,
+    I2C_STATE_ACK,
     I2C_STATE_STOP,
     I2C_STATE_DONE
 } i2c_state_t;
@@ -60,6 +66,7 @@ typedef struct
     bool busy;
     i2c_transaction_t current;
     i2c_state_t state;
+    i2c_event_t result; // reported once, after STOP
     uint8_t tx_index, rx_index;
 } i2c_async_t;
 
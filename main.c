@@ -13,21 +13,21 @@
 #include <libpic30.h>
 #include "i2c_async.h"
 #include "relay_pwm_manager.h"
-#include "pod_manager_async.h"
+#include "pod_manager.h"
 
 static i2c_async_t i2c1_async;
-static pod_manager_async_t podman;
+static pod_manager_t podman;
 
 void system_init(void)
 {
     static const i2c_regs_t i2c1_regs = {
         &I2C1CONL, &I2C1STAT, &I2C1BRG, &I2C1TRN, &I2C1RCV};
     i2c_async_init(&i2c1_async, &i2c1_regs, 0x4E);
-    pod_manager_async_init(&podman, &i2c1_async);
+    pod_manager_init(&podman, &i2c1_async);
     relay_pwm_init();
     T3CON = 0;
     TMR3 = 0;
-    PR3 = (uint16_t)((16000000UL / 256UL) * 0.1);
+    PR3 = (uint16_t)((16000000UL / 256UL) * POD_POLL_SLOT_MS / 1000UL);
     T3CONbits.TCKPS = 0b11;
     IFS0bits.T3IF = 0;
     IEC0bits.T3IE = 1;
@@ -38,7 +38,7 @@ void system_init(void)
 void __attribute__((__interrupt__, no_auto_psv)) _T3Interrupt(void)
 {
     IFS0bits.T3IF = 0;
-    pod_manager_async_poll(&podman);
+    pod_manager_poll(&podman);
 }
 
 int main(void)
@@ -47,15 +47,19 @@ int main(void)
 
     while (1)
     {
-        pod_manager_async_poll(&podman);
+        // Bays are polled from _T3Interrupt, one per tick
 
-        // Fire pod 2R at 70% intensity for 5 seconds
-        if (podman.pods[1].active)
+        // Fire the scent in pod 2R at 70% intensity for 5 seconds, then rest
+        // 1 second. The step names the scent: the pod manager picks an active
+        // pod holding it when the step starts, or plays silence if it is gone.
+        pod_snapshot_t snap;
+        pod_manager_snapshot(&podman, 1, &snap);
+        if (snap.active && relay_pwm_seq_idle(RELAY_CHANNEL_RIGHT))
         {
-            pod_manager_fire(&podman, 1, 5000, 70);
-            __delay_ms(6000);
+            relay_step_t step = {RELAY_POD_SCENT, 70, snap.meta.scent, 5000, 1000};
+            relay_pwm_queue(RELAY_CHANNEL_RIGHT, &step);
         }
 
-        __delay_ms(100);
+        Idle(); // until the next interrupt; the poll tick wakes us every slot
     }
 }
\ No newline at end of file
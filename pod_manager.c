@@ -1,125 +1,1016 @@
 #include "pod_manager.h"
+#include "crc16.h"
 #include <string.h>
 
+/**
+ * Note that the i2c addess and relay pin mapping goes
+ * Pod:         1R      2R      3R      1L      2L      3L
+ * Pod number:  0       1       2       3       4       5
+ * E2,E1,E0:    001     011     111     110     101     100
+ * i2c Address: 0x51    0x53    0x57    0x56    0x55    0x54
+ * Pin:         RB7     RB8     RB9     RE1     RE0     RF1
+ */
+static const uint8_t POD_ADDRS[POD_BAY_COUNT] = {0x51, 0x53, 0x57, 0x56, 0x55, 0x54};
+
 static pod_manager_t *g_pm = NULL;
 
-// E2:E1:E0 mapping table for six bays
-static const uint8_t pod_addr_map[POD_BAY_COUNT] = {
-    0x51, 0x52, 0x53, 0x54, 0x55, 0x56};
+static void pod_read_done(void *ctx, eeproma_result_t res);
+static uint8_t pod_resolve_scent(void *ctx, uint16_t scent, uint8_t channel);
+static void pod_uid_done(void *ctx, eeproma_result_t res);
+static void pod_slot_done(void *ctx, eeproma_result_t res);
+static void pod_probe_done(void *ctx, eeproma_result_t res);
+static void pod_write_done(void *ctx, eeproma_result_t res);
+static void pod_journal_done(void *ctx, eeproma_result_t res);
+
+// Every writer updates the inactive slot with generation + 1, so that one
+// byte is all a steady-state poll needs to read to notice a change.
+static inline uint16_t pod_watch_addr(const pod_t *p)
+{
+    return pod_record_slot_addr(p->meta.slot ^ 1) + POD_REC_GENERATION;
+}
+
+static bool pod_read_full(pod_t *p)
+{
+    return pod_port_read(&p->port, POD_UID_ADDR, p->buf, POD_EEPROM_BLOCK_SIZE,
+                                    pod_read_done, p);
+}
+
+static bool pod_read_uid(pod_t *p)
+{
+    return pod_port_read(&p->port, POD_UID_ADDR, p->buf, POD_UID_SIZE, pod_uid_done, p);
+}
+
+// Both record slots following an already fetched UID (a current-address
+// read), landing after it in buf: pod_read_done decodes them, pod_slot_done
+// checks them against a cache hit first
+static bool pod_read_records(pod_t *p, eeproma_callback_t done)
+{
+    return pod_port_read(&p->port, POD_UID_ADDR + POD_UID_SIZE, &p->buf[POD_UID_SIZE],
+                         POD_EEPROM_BLOCK_SIZE - POD_UID_SIZE, done, p);
+}
 
 // ------------------------------------------------------------
-// Callbacks
+// Poll scheduling: every bay carries its own due time on the poll clock
 // ------------------------------------------------------------
+// A bay is only looked at in its own slot, once per POD_POLL_PERIOD_MS, so
+// it is served in the slot nearest its due time rather than the first one
+// after it: intervals land within half a pass instead of rounding up to
+// the next whole pass (100 ms settle would otherwise take 192).
+static inline bool pod_is_due(const pod_manager_t *pm, const pod_t *p)
+{
+    return (int16_t)(p->due - pm->now) < (int16_t)(POD_POLL_PERIOD_MS / 2);
+}
+
+static uint16_t pod_interval(const pod_t *p)
+{
+    switch (p->state)
+    {
+    case POD_STATE_INSERTING:
+    case POD_STATE_REMOVING:
+        return POD_POLL_SETTLE_MS;
+    case POD_STATE_PRESENT:
+        return POD_POLL_PRESENT_MS;
+    case POD_STATE_EMPTY:
+    case POD_STATE_INVALID:
+    default:
+        return POD_POLL_EMPTY_MS;
+    }
+}
 
-typedef struct
+// Next service time for a bay just polled (or whose state just changed)
+static void pod_schedule(pod_t *p)
 {
-    pod_manager_t *pm;
-    uint8_t bay;
-} pod_cb_ctx_t;
+    uint16_t now = g_pm ? g_pm->now : 0;
+    uint16_t interval = pod_interval(p);
 
-#ifdef OLD_MANAGER
+    if (p->firing)
+    {
+        // Unsigned countdown: fires run up to 65.5 s, past the reach of a
+        // signed compare on the 16-bit clock
+        uint16_t elapsed = (uint16_t)(now - p->fire_mark);
+        p->fire_mark = now;
+        p->fire_left_ms = (p->fire_left_ms > elapsed) ? (uint16_t)(p->fire_left_ms - elapsed) : 0;
+        if (p->fire_left_ms)
+        {
+            // Land the next probe right after the fire ends
+            if (p->fire_left_ms < interval)
+            {
+                interval = p->fire_left_ms;
+            }
+        }
+        else
+        {
+            p->firing = false; // this poll was the post-fire check
+        }
+    }
+    p->due = now + interval;
+}
+
+// ------------------------------------------------------------
+// Snapshots: the owner of a claimed bay fills the back buffer and
+// publishes it with a single sequence increment. Readers retry if the
+// sequence moved while they copied.
+// ------------------------------------------------------------
+static void pod_publish(pod_t *p)
+{
+    pod_snapshot_t *s = &p->snap[(uint8_t)(p->snap_seq + 1) & 1];
+    s->active = p->active;
+    s->state = p->state;
+    s->low = p->low;
+    s->meta = p->meta;
+    s->stats = p->stats;
+    p->snap_seq++;
+}
 
-static void eeprom_read_complete(void *ctx, i2c_event_t event)
+// Ends a claim on the bay, publishing whatever the transfer changed
+static inline void pod_release(pod_t *p)
 {
-    pod_cb_ctx_t *c = (pod_cb_ctx_t *)ctx;
-    pod_t *p = &c->pm->pods[c->bay];
+    pod_publish(p);
+    p->busy = false;
+}
 
-    if (event == I2C_EVENT_COMPLETE)
+static void pod_set_state(pod_t *p, pod_state_t state)
+{
+    p->state = state;
+    p->debounce = 0;
+    p->active = (state == POD_STATE_PRESENT || state == POD_STATE_REMOVING);
+    if (state == POD_STATE_EMPTY)
     {
-        // EEPROM layout (example)
-        // [0..15]  128-bit unique ID
-        // [16..17] Scent ID
-        // [18..19] Remaining volume
-        // [20..21] Frequency (uint16_t)
-        memcpy(p->uid, p->eeprom_buf, 16);
-        p->scent = (p->eeprom_buf[16] << 8) | p->eeprom_buf[17];
-        p->remaining = (p->eeprom_buf[18] << 8) | p->eeprom_buf[19];
-        p->frequency = (p->eeprom_buf[20] << 8) | p->eeprom_buf[21];
-        p->init = true;
+        // Usage not yet written back leaves with the pod
+        p->unsaved = 0;
+        p->dose = 0;
+        p->low = false;
+        p->fire_pending = false;
+        p->firing = false;
+        p->migrate = false;
+        p->flush = false;
+        p->flush_pending = false;
+        p->stats.fires = 0;
+        p->stats.used = 0;
     }
-    else
+    pod_schedule(p);
+}
+
+// ------------------------------------------------------------
+// UID / scent index (completion handler context)
+// ------------------------------------------------------------
+static void pod_index_rebuild(pod_manager_t *pm)
+{
+    pod_index_t *ix = &pm->index;
+    ix->uid_bays = 0;
+    ix->route_count = 0;
+
+    for (uint8_t i = 0; i < POD_BAY_COUNT; i++)
+    {
+        const pod_t *p = &pm->pods[i];
+        if (!p->active)
+        {
+            continue;
+        }
+        ix->uid_hash[i] = crc16_update(CRC16_INIT, p->meta.uid, POD_UID_SIZE);
+        ix->uid_bays |= (uint8_t)(1u << i);
+
+        uint8_t r;
+        for (r = 0; r < ix->route_count; r++)
+        {
+            if (ix->routes[r].scent == p->meta.scent)
+            {
+                break;
+            }
+        }
+        if (r == ix->route_count)
+        {
+            ix->routes[r].scent = p->meta.scent;
+            ix->routes[r].bays = 0;
+            ix->route_count++;
+        }
+        ix->routes[r].bays |= (uint8_t)(1u << i);
+    }
+}
+
+// ------------------------------------------------------------
+// UID-keyed LRU metadata cache (completion handler context)
+// ------------------------------------------------------------
+static void pod_cache_put(pod_manager_t *pm, const pod_t *p)
+{
+    uint16_t hash = crc16_update(CRC16_INIT, p->meta.uid, POD_UID_SIZE);
+    pod_cache_entry_t *slot = &pm->cache[0];
+
+    for (uint8_t i = 0; i < POD_CACHE_ENTRIES; i++)
+    {
+        pod_cache_entry_t *c = &pm->cache[i];
+        if (!c->valid)
+        {
+            slot = c;
+            break;
+        }
+        // Oldest entry by wrap-safe age
+        if ((uint8_t)(pm->cache_clock - c->stamp) > (uint8_t)(pm->cache_clock - slot->stamp))
+        {
+            slot = c;
+        }
+    }
+
+    slot->valid = true;
+    slot->stamp = pm->cache_clock++;
+    slot->uid_hash = hash;
+    slot->meta = p->meta;
+    slot->watch_gen = p->watch_gen;
+    slot->unsaved = p->unsaved;
+    slot->dose = p->dose;
+    slot->last_use = p->last_use;
+    slot->freq_dirty = p->freq_dirty;
+    slot->stats = p->stats;
+}
+
+// Drops the RAM-only usage and frequency a cache hit brought in
+static void pod_shadow_clear(pod_t *p)
+{
+    p->unsaved = 0;
+    p->dose = 0;
+    p->freq_dirty = false;
+}
+
+// Moves a cached entry matching uid into p; the pod owns it while inserted
+static bool pod_cache_take(pod_manager_t *pm, pod_t *p, const uint8_t *uid)
+{
+    uint16_t hash = crc16_update(CRC16_INIT, uid, POD_UID_SIZE);
+
+    for (uint8_t i = 0; i < POD_CACHE_ENTRIES; i++)
+    {
+        pod_cache_entry_t *c = &pm->cache[i];
+        if (c->valid && c->uid_hash == hash && memcmp(c->meta.uid, uid, POD_UID_SIZE) == 0)
+        {
+            c->valid = false;
+            p->meta = c->meta;
+            p->watch_gen = c->watch_gen;
+            p->unsaved = c->unsaved;
+            p->dose = c->dose;
+            p->last_use = c->last_use;
+            p->freq_dirty = c->freq_dirty;
+            p->stats = c->stats;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void pod_raise(pod_t *p, pod_event_t event)
+{
+    if (g_pm && event != POD_EVENT_LOW)
+    {
+        pod_index_rebuild(g_pm);
+    }
+    if (g_pm && g_pm->event_cb)
+    {
+        g_pm->event_cb(g_pm->event_ctx, p->bay, event);
+    }
+}
+
+static void pod_check_low(pod_t *p)
+{
+    uint16_t threshold = g_pm ? g_pm->low_remaining : POD_LOW_REMAINING_DEFAULT;
+    if (p->meta.remaining > threshold)
+    {
+        p->low = false; // refilled or replaced
+    }
+    else if (!p->low)
+    {
+        p->low = true;
+        pod_raise(p, POD_EVENT_LOW);
+    }
+}
+
+// ------------------------------------------------------------
+// Usage stats journal: counts are merged into the slot after the newest
+// one in stats_image and only reach the EEPROM in batches, see
+// POD_STATS_MAX_UPDATES. Busy-claimed / completion context only.
+// ------------------------------------------------------------
+static void pod_stats_note(pod_t *p)
+{
+    uint8_t slot[POD_STATS_SLOT_SIZE];
+    pod_stats_encode(p->meta.uid, &p->stats, slot);
+    (void)eeprom_journal_write(&p->journal, g_pm ? g_pm->now : 0,
+                               (uint16_t)((p->stats_slot ^ 1) * POD_STATS_SLOT_SIZE), slot, POD_STATS_SLOT_SIZE);
+}
+
+// Stats from the freshly read image, merged with any counted while the pod
+// was out of reach (a cache hit brings those back in p->stats). The counts
+// only grow, so the larger of each is the newer.
+static void pod_stats_load(pod_t *p)
+{
+    pod_stats_t held = p->stats;
+    memcpy(p->stats_image, &p->buf[POD_STATS_ADDR], POD_STATS_SIZE);
+    (void)eeprom_journal_init(&p->journal, p->stats_image, POD_STATS_ADDR, POD_STATS_SIZE, POD_STATS_SLOT_SIZE,
+                              POD_STATS_MAX_UPDATES, POD_STATS_MAX_AGE_MS);
+    (void)pod_stats_decode(p->meta.uid, p->stats_image, &p->stats, &p->stats_slot);
+    if (held.fires > p->stats.fires || held.used > p->stats.used)
     {
-        // NACK or timeout ? consider pod removed
-        p->init = false;
+        p->stats.fires = (held.fires > p->stats.fires) ? held.fires : p->stats.fires;
+        p->stats.used = (held.used > p->stats.used) ? held.used : p->stats.used;
+        pod_stats_note(p);
     }
 }
 
+// Writes the next journaled stats slot if the journal says it is time
+static bool pod_journal_flush(pod_manager_t *pm, pod_t *p)
+{
+    uint16_t addr;
+    uint16_t len;
+    const uint8_t *buf;
+
+    if (!eeprom_journal_due(&p->journal, pm->now) || !eeprom_journal_next(&p->journal, &addr, &buf, &len))
+    {
+        return false;
+    }
+    if (pod_port_write(&p->port, addr, buf, (uint8_t)len, pod_journal_done, p))
+    {
+        return true;
+    }
+    eeprom_journal_done(&p->journal, false);
+    return false;
+}
+
 // ------------------------------------------------------------
-// Pod discovery and polling
+// Volume accounting: the relay ISR integrates PWM on-time * duty per pod,
+// which is converted here into whole units off meta.remaining. Only called
+// while the pod is busy-claimed so the completion handlers keep out.
 // ------------------------------------------------------------
+static void pod_account(pod_manager_t *pm, pod_t *p)
+{
+    uint16_t fires = relay_pwm_take_fires(p->bay);
+    uint32_t fresh = relay_pwm_take_dose(p->bay);
+    uint32_t units = 0;
+
+    if (fresh)
+    {
+        p->last_use = pm->now;
+        uint32_t dose = p->dose + fresh;
+        units = dose / POD_DOSE_PER_UNIT;
+        p->dose = dose - units * POD_DOSE_PER_UNIT;
+        if (units > p->meta.remaining)
+        {
+            units = p->meta.remaining;
+        }
+    }
+
+    if (units)
+    {
+        p->meta.remaining -= (uint16_t)units;
+        p->unsaved += (uint16_t)units;
+        pod_check_low(p);
+    }
+    if (fires || units)
+    {
+        p->stats.fires += fires;
+        p->stats.used += units;
+        pod_stats_note(p);
+    }
+}
+
+static bool pod_writeback_due(const pod_manager_t *pm, const pod_t *p)
+{
+    if (p->freq_dirty || p->migrate || (p->flush && p->unsaved))
+    {
+        return true; // retried once per verification poll until it lands
+    }
+    return p->unsaved &&
+           (p->unsaved >= POD_WRITEBACK_UNITS || (uint16_t)(pm->now - p->last_use) >= POD_WRITEBACK_IDLE_MS);
+}
+
+// A new frequency from pod_manager_set_frequency, taken over while the
+// pod is busy-claimed
+static void pod_take_frequency(pod_t *p)
+{
+    if (!p->freq_pending)
+    {
+        return;
+    }
+    p->meta.frequency = p->freq_request;
+    p->meta.prescale = p->freq_request_prescale;
+    p->freq_pending = false;
+    p->freq_dirty = true;
+    relay_pwm_set_carrier(p->bay, p->meta.frequency, p->meta.prescale);
+}
+
+// A pod_manager_flush request, taken over while the pod is busy-claimed
+static void pod_take_flush(pod_t *p)
+{
+    if (!p->flush_pending)
+    {
+        return;
+    }
+    p->flush_pending = false;
+    p->flush = (p->unsaved != 0);
+    eeprom_journal_request_flush(&p->journal);
+}
+
+// Lazy write-back into the inactive slot; the active one stays intact
+// until the new record has landed
+static bool pod_write_back(pod_manager_t *pm, pod_t *p)
+{
+    uint16_t addr = pod_record_encode_next(&p->meta, p->buf);
+    p->last_use = pm->now; // a failed attempt backs off for a full idle period
+    return pod_port_write(&p->port, addr, p->buf, POD_RECORD_SIZE, pod_write_done, p);
+}
+
+static void pod_manager_setup(pod_manager_t *pm)
+{
+    pm->insert_debounce = POD_INSERT_DEBOUNCE_DEFAULT;
+    pm->remove_debounce = POD_REMOVE_DEBOUNCE_DEFAULT;
+    pm->low_remaining = POD_LOW_REMAINING_DEFAULT;
+    for (uint8_t i = 0; i < POD_BAY_COUNT; i++)
+    {
+        pm->pods[i].bay = i;
+        pod_set_state(&pm->pods[i], POD_STATE_EMPTY);
+    }
+    g_pm = pm;
+    relay_pwm_set_resolver(pod_resolve_scent, pm);
+}
 
 void pod_manager_init(pod_manager_t *pm, i2c_async_t *bus)
 {
     memset(pm, 0, sizeof(*pm));
-    pm->i2c = bus;
+    for (uint8_t i = 0; i < POD_BAY_COUNT; i++)
+    {
+        pod_port_init_async(&pm->pods[i].port, bus, POD_ADDRS[i]);
+    }
+    pod_manager_setup(pm);
+}
 
+void pod_manager_init_blocking(pod_manager_t *pm, i2c_t *bus)
+{
+    memset(pm, 0, sizeof(*pm));
     for (uint8_t i = 0; i < POD_BAY_COUNT; i++)
     {
-        pm->pods[i].position = i;
-        pm->pods[i].init = false;
-        pm->pods[i].eeprom.bus = bus;
-        pm->pods[i].eeprom.address = pod_addr_map[i];
+        pod_port_init_blocking(&pm->pods[i].port, bus, POD_ADDRS[i]);
     }
-    g_pm = pm;
+    pod_manager_setup(pm);
 }
 
-// Probe a single address to see if it ACKs
-static void probe_address_async(pod_manager_t *pm, uint8_t bay)
+void pod_manager_snapshot(const pod_manager_t *pm, uint8_t bay, pod_snapshot_t *out)
 {
-    uint8_t addr = pod_addr_map[bay];
+    if (bay >= POD_BAY_COUNT)
+    {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    const pod_t *p = &pm->pods[bay];
+    uint8_t seq;
 
-    i2c_transaction_t probe = {
-        .address = addr,
-        .tx_buf = NULL,
-        .tx_len = 0,
-        .rx_buf = NULL,
-        .rx_len = 0,
-        .cb = NULL,
-        .context = NULL};
+    do
+    {
+        seq = p->snap_seq;
+        *out = p->snap[seq & 1];
+    } while (seq != p->snap_seq);
+}
 
-    bool ok = i2c_async_submit(pm->i2c, &probe);
+bool pod_manager_is_active(const pod_manager_t *pm, uint8_t bay)
+{
+    return (bay < POD_BAY_COUNT) && pm->pods[bay].snap[pm->pods[bay].snap_seq & 1].active;
+}
 
+void pod_manager_flush(pod_manager_t *pm)
+{
+    for (uint8_t i = 0; i < POD_BAY_COUNT; i++)
+    {
+        pod_t *p = &pm->pods[i];
+        if (p->active)
+        {
+            p->flush_pending = true;
+            p->due = pm->now; // verify in the bay's next slot
+        }
+    }
+}
+
+bool pod_manager_flushed(const pod_manager_t *pm)
+{
+    for (uint8_t i = 0; i < POD_BAY_COUNT; i++)
+    {
+        const pod_t *p = &pm->pods[i];
+        if (p->state == POD_STATE_PRESENT && (p->flush_pending || p->unsaved || p->freq_dirty || p->migrate ||
+                                              eeprom_journal_pending(&p->journal)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void pod_manager_set_debounce(pod_manager_t *pm, uint8_t insert_polls, uint8_t remove_polls)
+{
+    pm->insert_debounce = insert_polls ? insert_polls : 1;
+    pm->remove_debounce = remove_polls ? remove_polls : 1;
+}
+
+void pod_manager_set_low_threshold(pod_manager_t *pm, uint16_t remaining)
+{
+    pm->low_remaining = remaining;
+}
+
+void pod_manager_set_event_cb(pod_manager_t *pm, pod_event_cb_t cb, void *ctx)
+{
+    pm->event_cb = NULL; // never let the ISR see a new cb with the old ctx
+    pm->event_ctx = ctx;
+    pm->event_cb = cb;
+}
+
+// Starts the bay's next transfer; at most one per bay is ever in flight
+static void pod_service(pod_manager_t *pm, pod_t *p)
+{
+    p->busy = true;
+    pod_schedule(p); // before the submit: completions may reschedule
+
+    bool ok;
+    switch (p->state)
+    {
+    case POD_STATE_INSERTING:
+        // Debounced: fetch the metadata, PRESENT once it decodes
+        ok = (p->debounce >= pm->insert_debounce)
+                 ? pod_read_uid(p)
+                 : pod_port_probe(&p->port, pod_probe_done, p);
+        break;
+
+    case POD_STATE_PRESENT:
+        // Always the watch probe first: a write-back is only chained on once
+        // it shows the inactive slot untouched, so it never lands on a refill
+        pod_account(pm, p);
+        pod_take_frequency(p);
+        pod_take_flush(p);
+        ok = pod_port_read(&p->port, pod_watch_addr(p), &p->probe, 1, pod_probe_done, p);
+        break;
+
+    case POD_STATE_REMOVING:
+        pod_account(pm, p);
+        ok = pod_port_read(&p->port, pod_watch_addr(p), &p->probe, 1, pod_probe_done, p);
+        break;
+
+    case POD_STATE_EMPTY:
+    case POD_STATE_INVALID:
+    default:
+        ok = pod_port_probe(&p->port, pod_probe_done, p);
+        break;
+    }
     if (!ok)
     {
+        pod_release(p);
+    }
+}
+
+// One bay per call, round robin: a full pass takes POD_POLL_PERIOD_MS and
+// the bus never sees more than one poll transfer queued at a time
+void pod_manager_poll(pod_manager_t *pm)
+{
+    pm->now += POD_POLL_SLOT_MS;
+
+    pod_t *p = &pm->pods[pm->slot];
+    pm->slot = (pm->slot + 1 < POD_BAY_COUNT) ? (uint8_t)(pm->slot + 1) : 0;
+
+    if (p->busy || !pod_is_due(pm, p))
+    {
+        return; // busy: previous transfer still owns p->buf / p->probe
+    }
+    pod_service(pm, p);
+}
+
+// ------------------------------------------------------------
+// Completion handlers (I2C ISR context; inside pod_manager_poll with the
+// blocking transport)
+// ------------------------------------------------------------
+static void pod_present(pod_t *p)
+{
+    pod_set_state(p, POD_STATE_PRESENT);
+    (void)relay_pwm_take_dose(p->bay); // left over from a previous pod
+    (void)relay_pwm_take_fires(p->bay);
+    pod_stats_load(p);
+    relay_pwm_set_carrier(p->bay, p->meta.frequency, p->meta.prescale);
+    pod_check_low(p);
+    pod_release(p);
+    pod_raise(p, POD_EVENT_INSERTED);
+}
+
+static void pod_uid_done(void *ctx, eeproma_result_t res)
+{
+    pod_t *p = (pod_t *)ctx;
+    if (res != EEPROMA_OK)
+    {
+        pod_port_forget_addr(&p->port);
+        pod_set_state(p, POD_STATE_EMPTY);
+        pod_release(p);
+        return;
+    }
+    if (g_pm && pod_cache_take(g_pm, p, p->buf))
+    {
+        // Seen before: check both slots against the cache, no decode
+        if (pod_read_records(p, pod_slot_done))
+        {
+            return;
+        }
+        pod_cache_put(g_pm, p); // back for the retry from the UID
+        pod_shadow_clear(p);
+        pod_release(p);
         return;
     }
+    if (!pod_read_records(p, pod_read_done))
+    {
+        pod_release(p); // retried from the UID on the next poll
+    }
+}
 
-    // Simple check: if bus accepted, assume device might be there.
-    // For full detection, try to read a known location (e.g., byte 0).
-    uint8_t buf[22];
-    pod_cb_ctx_t *ctx = malloc(sizeof(pod_cb_ctx_t));
-    ctx->pm = pm;
-    ctx->bay = bay;
+// Cache hit check: the cached usage only applies if neither slot changed
+// since it was counted. A refill by the A/B protocol writes the inactive
+// slot (its generation byte moves off watch_gen); one that rewrote the
+// active slot in place shows up as a different generation or remaining.
+static void pod_slot_done(void *ctx, eeproma_result_t res)
+{
+    pod_t *p = (pod_t *)ctx;
+    if (res == EEPROMA_OK && p->buf[pod_watch_addr(p)] == p->watch_gen &&
+        pod_record_matches(p->buf, &p->buf[pod_record_slot_addr(p->meta.slot)], p->meta.generation,
+                           (uint16_t)(p->meta.remaining + p->unsaved)))
+    {
+        pod_present(p);
+        return;
+    }
+
+    if (res != EEPROMA_OK)
+    {
+        if (g_pm)
+        {
+            pod_cache_put(g_pm, p); // pulled again: still unverified
+        }
+        pod_shadow_clear(p);
+        pod_port_forget_addr(&p->port);
+        pod_set_state(p, POD_STATE_EMPTY);
+        pod_release(p);
+        return;
+    }
+    pod_shadow_clear(p); // rewritten: the cached usage was for the old contents
+    pod_read_done(p, res); // the full image is already in buf
+}
 
-    i2c_transaction_t t = {
-        .address = addr,
-        .tx_buf = (uint8_t[]){0x00},
-        .tx_len = 1,
-        .rx_buf = buf,
-        .rx_len = 22, // enough to read metadata
-        .cb = eeprom_read_complete,
-        .context = ctx};
-    pm->pods[bay].eeprom_buf = buf;
-    i2c_async_submit(pm->i2c, &t);
+static void pod_read_done(void *ctx, eeproma_result_t res)
+{
+    pod_t *p = (pod_t *)ctx;
+    // Decode into a scratch copy so a bad CRC never touches p->meta
+    pod_meta_t m;
+    pod_record_status_t st = (res == EEPROMA_OK) ? pod_record_decode(p->buf, &m) : POD_RECORD_INVALID;
+    if (st != POD_RECORD_INVALID)
+    {
+        if (st == POD_RECORD_LEGACY)
+        {
+            p->migrate = true; // rewritten into slot A by the first write-back
+        }
+        // Usage not yet written back still applies to the fresh record
+        m.remaining = (m.remaining > p->unsaved) ? (uint16_t)(m.remaining - p->unsaved) : 0;
+        if (p->freq_dirty)
+        {
+            m.frequency = p->meta.frequency;
+            m.prescale = p->meta.prescale;
+        }
+        p->meta = m;
+        relay_pwm_set_carrier(p->bay, m.frequency, m.prescale);
+        p->watch_gen = p->buf[pod_watch_addr(p)];
+        if (p->state == POD_STATE_INSERTING)
+        {
+            pod_present(p);
+            return;
+        }
+        pod_check_low(p);
+        if (g_pm)
+        {
+            pod_index_rebuild(g_pm); // rewritten in place: scent may differ
+        }
+    }
+    else
+    {
+        // Pod may have been swapped: its address pointer is no longer ours.
+        // A bad CRC is simply retried; a pod that stopped ACKing mid-insert
+        // goes back to EMPTY. Removal of a PRESENT pod is left to the probes.
+        pod_port_forget_addr(&p->port);
+        if (res != EEPROMA_OK && p->state == POD_STATE_INSERTING)
+        {
+            pod_set_state(p, POD_STATE_EMPTY);
+        }
+        else if (p->state == POD_STATE_INSERTING &&
+                 ++p->debounce >= (uint8_t)((g_pm ? g_pm->insert_debounce : 1) + POD_DECODE_RETRIES))
+        {
+            // Blank or corrupt, not a torn read: stop re-reading it
+            pod_set_state(p, POD_STATE_INVALID);
+            pod_release(p);
+            pod_raise(p, POD_EVENT_INVALID);
+            return;
+        }
+    }
+    pod_release(p);
 }
 
-void pod_manager_poll(pod_manager_t *pm)
+static void pod_probe_done(void *ctx, eeproma_result_t res)
 {
-    for (uint8_t i = 0; i < POD_BAY_COUNT; i++)
+    pod_t *p = (pod_t *)ctx;
+    bool ack = (res == EEPROMA_OK);
+    uint8_t remove_debounce = g_pm ? g_pm->remove_debounce : 1;
+
+    switch (p->state)
     {
-        probe_address_async(pm, i);
+    case POD_STATE_EMPTY:
+        if (ack)
+        {
+            pod_set_state(p, POD_STATE_INSERTING);
+            p->debounce = 1;
+        }
+        break;
+
+    case POD_STATE_INVALID:
+        if (ack)
+        {
+            p->debounce = 0;
+        }
+        else if (++p->debounce >= remove_debounce)
+        {
+            pod_port_forget_addr(&p->port);
+            pod_set_state(p, POD_STATE_EMPTY);
+            pod_release(p);
+            pod_raise(p, POD_EVENT_REMOVED);
+            return;
+        }
+        break;
+
+    case POD_STATE_INSERTING:
+        if (ack)
+        {
+            p->debounce++;
+        }
+        else
+        {
+            pod_set_state(p, POD_STATE_EMPTY);
+        }
+        break;
+
+    case POD_STATE_PRESENT:
+    case POD_STATE_REMOVING:
+        if (!ack)
+        {
+            p->fire_pending = false; // never fire into a bay that stopped ACKing
+            if (p->state == POD_STATE_PRESENT)
+            {
+                pod_set_state(p, POD_STATE_REMOVING);
+            }
+            if (++p->debounce >= remove_debounce)
+            {
+                if (g_pm)
+                {
+                    pod_cache_put(g_pm, p);
+                }
+                pod_port_forget_addr(&p->port);
+                p->freq_pending = false;
+                p->freq_dirty = false;
+                relay_pwm_set_carrier(p->bay, RELAY_PERIOD_DEFAULT, 0);
+                pod_set_state(p, POD_STATE_EMPTY);
+                pod_release(p);
+                pod_raise(p, POD_EVENT_REMOVED);
+                return;
+            }
+            break;
+        }
+        if (p->state == POD_STATE_REMOVING)
+        {
+            pod_set_state(p, POD_STATE_PRESENT); // contact bounce
+        }
+        if (p->fire_pending)
+        {
+            // Verified just now: start the queued fire and check again
+            // the moment it ends
+            (void)relay_pwm_start(p->bay, &p->fire_wave[p->fire_next]); // compiled by pod_manager_fire
+            p->fire_pending = false;
+            p->firing = true;
+            p->fire_left_ms = p->fire_duration_ms;
+            p->fire_mark = g_pm ? g_pm->now : 0;
+            pod_schedule(p);
+        }
+        if (p->probe != p->watch_gen)
+        {
+            if (pod_read_full(p))
+            {
+                return; // inactive slot rewritten: busy until the full read lands
+            }
+        }
+        else if (p->state == POD_STATE_PRESENT && g_pm && pod_writeback_due(g_pm, p) && pod_write_back(g_pm, p))
+        {
+            return; // slot seen untouched just now: busy until the write lands
+        }
+        else if (p->state == POD_STATE_PRESENT && g_pm && pod_journal_flush(g_pm, p))
+        {
+            return; // busy until the stats slot lands
+        }
+        break;
     }
+    pod_release(p);
+}
+
+static void pod_write_done(void *ctx, eeproma_result_t res)
+{
+    pod_t *p = (pod_t *)ctx;
+    if (res == EEPROMA_OK)
+    {
+        // The slot we wrote is now active; the old one becomes the watched
+        // one and still holds the previous generation
+        pod_record_commit(&p->meta);
+        p->watch_gen = (uint8_t)(p->meta.generation - 1);
+        p->unsaved = 0;
+        p->freq_dirty = false;
+        p->migrate = false;
+        p->flush = false;
+        if (g_pm && pod_journal_flush(g_pm, p))
+        {
+            return; // stats due as well: straight behind the record
+        }
+    }
+    // On failure unsaved stays put and is retried after the next idle period
+    pod_release(p);
+}
+
+static void pod_journal_done(void *ctx, eeproma_result_t res)
+{
+    pod_t *p = (pod_t *)ctx;
+    bool ok = (res == EEPROMA_OK);
+    if (ok)
+    {
+        p->stats_slot ^= 1; // the slot just written holds the newest counts
+    }
+    eeprom_journal_done(&p->journal, ok); // a failed slot is retried next poll
+    pod_release(p);
+}
+
+void pod_manager_fire(pod_manager_t *pm, uint8_t bay, uint16_t duration_ms, uint8_t intensity)
+{
+    pod_manager_fire_level(pm, bay, duration_ms, RELAY_LEVEL(intensity));
+}
+
+void pod_manager_fire_level(pod_manager_t *pm, uint8_t bay, uint16_t duration_ms, uint16_t level)
+{
+    if (bay >= POD_BAY_COUNT)
+    {
+        return;
+    }
+    pod_t *p = &pm->pods[bay];
+    if (!p->active)
+    {
+        return;
+    }
+
+    // Compiled here, not in the probe completion (I2C ISR), into whichever
+    // table the relay is not playing. Withdrawing the pending fire first
+    // keeps the completion off the table while it is rewritten.
+    uint16_t ipl;
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    p->fire_pending = false;
+    if (relay_pwm_wave_busy(&p->fire_wave[p->fire_next]))
+    {
+        p->fire_next ^= 1;
+    }
+    RESTORE_CPU_IPL(ipl);
+
+    if (!relay_pwm_compile(&p->fire_wave[p->fire_next], duration_ms, level))
+    {
+        return;
+    }
+    p->fire_duration_ms = duration_ms;
+    p->fire_pending = true; // published last
+    p->due = pm->now; // verify in the bay's next slot
 }
 
 // ------------------------------------------------------------
-// Timer integration
+// Carrier frequency and calibration
 // ------------------------------------------------------------
+static bool pod_request_carrier(pod_manager_t *pm, uint8_t bay, uint16_t period, uint8_t prescale)
+{
+    if (bay >= POD_BAY_COUNT || !pm->pods[bay].active)
+    {
+        return false;
+    }
+    pod_t *p = &pm->pods[bay];
+    p->freq_request = period;
+    p->freq_request_prescale = prescale;
+    p->freq_pending = true; // published last
+    p->due = pm->now;
+    return true;
+}
 
-void pod_manager_tick_100ms(void)
+bool pod_manager_set_frequency(pod_manager_t *pm, uint8_t bay, uint32_t freq_hz)
 {
-    if (g_pm)
+    relay_plan_t plan = {RELAY_PERIOD_DEFAULT, 0, 0};
+    if (freq_hz && !relay_pwm_plan(freq_hz, &plan))
     {
-        pod_manager_poll(g_pm);
+        return false;
     }
+    return pod_request_carrier(pm, bay, plan.period, plan.tmrps);
+}
+
+bool pod_manager_calibrate(pod_manager_t *pm, uint8_t bay, const relay_sweep_t *sweep)
+{
+    if (!pod_manager_is_active(pm, bay))
+    {
+        return false;
+    }
+    return relay_pwm_sweep(bay, sweep);
+}
+
+bool pod_manager_calibrate_pick(pod_manager_t *pm, uint8_t bay)
+{
+    if (bay >= POD_BAY_COUNT)
+    {
+        return false;
+    }
+    uint16_t period;
+    if (!relay_pwm_sweep_pick(bay, &period))
+    {
+        return false; // the bay's sweep is over, replaced or never started
+    }
+    return pod_request_carrier(pm, bay, period, 0); // sweeps run at 1:1
+}
+
+// ------------------------------------------------------------
+// Index lookups
+// ------------------------------------------------------------
+bool pod_manager_find_uid(pod_manager_t *pm, const uint8_t *uid, uint8_t *bay)
+{
+    uint16_t hash = crc16_update(CRC16_INIT, uid, POD_UID_SIZE);
+    bool found = false;
+    uint16_t ipl;
+
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    for (uint8_t i = 0; i < POD_BAY_COUNT && !found; i++)
+    {
+        if ((pm->index.uid_bays & (1u << i)) && pm->index.uid_hash[i] == hash &&
+            memcmp(pm->pods[i].meta.uid, uid, POD_UID_SIZE) == 0)
+        {
+            *bay = i;
+            found = true;
+        }
+    }
+    RESTORE_CPU_IPL(ipl);
+    return found;
+}
+
+uint8_t pod_manager_scent_bays(pod_manager_t *pm, uint16_t scent)
+{
+    uint8_t bays = 0;
+    uint16_t ipl;
+
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    for (uint8_t r = 0; r < pm->index.route_count; r++)
+    {
+        if (pm->index.routes[r].scent == scent)
+        {
+            bays = pm->index.routes[r].bays;
+            break;
+        }
+    }
+    RESTORE_CPU_IPL(ipl);
+    return bays;
+}
+
+// Fullest active bay holding scent among bays, POD_BAY_COUNT if none has
+// any left
+static uint8_t pod_pick_scent(pod_manager_t *pm, uint16_t scent, uint8_t bays)
+{
+    bays &= pod_manager_scent_bays(pm, scent);
+    uint8_t best = POD_BAY_COUNT;
+    uint16_t best_remaining = 0;
+    pod_snapshot_t snap;
+
+    for (uint8_t i = 0; i < POD_BAY_COUNT; i++)
+    {
+        if (!(bays & (1u << i)))
+        {
+            continue;
+        }
+        pod_manager_snapshot(pm, i, &snap);
+        if (snap.active && snap.meta.remaining > best_remaining)
+        {
+            best_remaining = snap.meta.remaining;
+            best = i;
+        }
+    }
+    return best;
+}
+
+bool pod_manager_fire_scent(pod_manager_t *pm, uint16_t scent, uint16_t duration_ms, uint8_t intensity)
+{
+    uint8_t best = pod_pick_scent(pm, scent, POD_BAYS_ALL);
+    if (best == POD_BAY_COUNT)
+    {
+        return false;
+    }
+    pod_manager_fire(pm, best, duration_ms, intensity);
+    return true;
+}
+
+// relay_pwm sequencer hook (Timer4 ISR): snapshots only, no bus traffic,
+// so scent steps start on time
+static uint8_t pod_resolve_scent(void *ctx, uint16_t scent, uint8_t channel)
+{
+    uint8_t bays = (uint8_t)(((1u << RELAY_PODS_PER_CHANNEL) - 1u) << (channel * RELAY_PODS_PER_CHANNEL));
+    uint8_t bay = pod_pick_scent((pod_manager_t *)ctx, scent, bays);
+    return (bay < POD_BAY_COUNT) ? bay : 0xFF;
 }
-#endif
\ No newline at end of file
@@ -7,30 +7,250 @@
  *
  * @copyright Copyright (c) 2025
  *
+ * Note that the i2c addess and relay pin mapping goes:
+ *
+ * Pod:         1R      2R      3R      1L      2L      3L
+ * ---------------------------------------------------------
+ * Pod number:  0       1       2       3       4       5
+ * E2,E1,E0:    001     011     111     110     101     100
+ * i2c Address: 0x51    0x53    0x57    0x56    0x55    0x54
+ * Pin:         RB7     RB8     RB9     RE1     RE0     RF1
+ *
  */
 
 #ifndef __POD_MANAGER_H__
 #define __POD_MANAGER_H__
 
-#include <stdint.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <xc.h>
 #include <libpic30.h>
-#include "pod.h"
-#include "i2c_async.h"
-#include "eeprom.h"
+#include "pod_transport.h"
+#include "relay_pwm_manager.h"
+#include "pod_record.h"
+#include "eeprom_journal.h"
 
 #define POD_BAY_COUNT 6
+#define POD_BAYS_ALL ((uint8_t)((1u << POD_BAY_COUNT) - 1u))
+#define POD_EEPROM_BLOCK_SIZE (POD_STATS_ADDR + POD_STATS_SIZE) // records + stats
+
+// pod_manager_poll must be called every POD_POLL_SLOT_MS. Each call owns
+// one bay in turn, so every bay gets a slot once per POD_POLL_PERIOD_MS and
+// is serviced in the slot nearest the end of its own, state dependent,
+// interval (intervals are effectively rounded to whole passes)
+#define POD_POLL_SLOT_MS 16
+#define POD_POLL_PERIOD_MS (POD_POLL_SLOT_MS * POD_BAY_COUNT)
+#define POD_POLL_EMPTY_MS 300    // presence probes while nothing is seated
+#define POD_POLL_SETTLE_MS 100   // debouncing an insertion / removal
+#define POD_POLL_PRESENT_MS 1000 // slow verification of a stable pod
+
+// Consecutive polls needed to accept an insertion / removal
+#define POD_INSERT_DEBOUNCE_DEFAULT 2
+#define POD_REMOVE_DEBOUNCE_DEFAULT 3
+// Metadata reads that may fail to decode before an inserting pod is INVALID
+#define POD_DECODE_RETRIES 3
+
+// Relay dose (intensity * ms, see relay_pwm_take_dose) that uses up one
+// unit of pod_meta_t.remaining. Calibrate against a weighed pod.
+#define POD_DOSE_PER_UNIT 50000UL
+
+// Write the RAM volume back once this many units are unsaved, or once any
+// unsaved usage has sat idle for this long
+#define POD_WRITEBACK_UNITS 16
+#define POD_WRITEBACK_IDLE_MS 5000
+
+// Usage stats (pod_stats_t) go through a write-combining journal, written
+// back once this many changes are pending or the oldest has waited this
+// long (or on pod_manager_flush). Up to that much is lost on power-down.
+#define POD_STATS_MAX_UPDATES 32
+#define POD_STATS_MAX_AGE_MS 60000u
+
+// Removed pods remembered by UID so a reinsertion skips the full decode
+#define POD_CACHE_ENTRIES 8
+
+// POD_EVENT_LOW fires when remaining drops to this level
+#define POD_LOW_REMAINING_DEFAULT 100
+
+/**
+ * Per-bay hot-plug state
+ *  EMPTY      no ACK; cheap address-only probes
+ *  INSERTING  ACKing, debouncing; UID read once the count is reached, then
+ *             both records, decoded or, on a metadata cache hit, checked
+ *             against the cache to confirm the pod was not refilled
+ *             meanwhile. A pre-record (legacy) pod is decoded and migrated
+ *             by its first write-back
+ *  PRESENT    metadata valid; one-byte generation probes (fireable). A
+ *             fire is held until a probe verifies the pod, and the bay is
+ *             probed again as soon as the fire has ended. Record
+ *             write-backs and journaled stats are chained on a probe
+ *             that finds the pod untouched
+ *  REMOVING   NACKing, debouncing; still fireable until the count is reached
+ *  INVALID    ACKing but its metadata never decoded (blank or corrupt);
+ *             address-only probes at the EMPTY rate until it is pulled
+ */
+typedef enum
+{
+    POD_STATE_EMPTY = 0,
+    POD_STATE_INSERTING,
+    POD_STATE_PRESENT,
+    POD_STATE_REMOVING,
+    POD_STATE_INVALID
+} pod_state_t;
+
+typedef enum
+{
+    POD_EVENT_INSERTED, // metadata loaded and valid
+    POD_EVENT_REMOVED,
+    POD_EVENT_LOW,    // remaining at or below the refill threshold
+    POD_EVENT_INVALID // seated pod with no usable metadata; REMOVED once pulled
+} pod_event_t;
+
+// Raised from the I2C ISR or from pod_manager_poll
+typedef void (*pod_event_cb_t)(void *ctx, uint8_t bay, pod_event_t event);
+
+// Consistent copy of a bay's public state, see pod_manager_snapshot
+typedef struct
+{
+    bool active;
+    pod_state_t state;
+    bool low;
+    pod_meta_t meta;
+    pod_stats_t stats;
+} pod_snapshot_t;
+
+typedef struct
+{
+    bool active;        // PRESENT or REMOVING
+    volatile bool busy; // metadata read in flight (buf owned by the bus)
+    pod_state_t state;
+    uint8_t debounce;   // consecutive polls agreeing with the pending state
+    uint8_t bay;
+    pod_meta_t meta;
+    uint8_t watch_gen; // generation byte last seen in the inactive slot
+    uint8_t probe;     // landing byte for the steady-state change probe
+    bool low;          // POD_EVENT_LOW raised, re-armed above the threshold
+    uint16_t last_use; // poll clock at the last new usage
+    uint16_t unsaved;  // units taken off meta.remaining not yet in EEPROM
+    uint32_t dose;     // relay dose not yet worth a whole unit
+    bool freq_dirty;   // meta.frequency changed, not yet in EEPROM
+    bool migrate;      // legacy layout decoded, not yet rewritten as a record
+    bool flush;        // pod_manager_flush: write the volume back now
+    volatile bool flush_pending; // pod_manager_flush waiting for the poll side
+    pod_stats_t stats;           // lifetime usage, RAM copy ahead of the EEPROM
+    uint8_t stats_slot;          // stats slot holding the newest written copy
+    uint8_t stats_image[POD_STATS_SIZE];
+    eeprom_journal_t journal;    // over stats_image, flushed after verification probes
+    volatile bool freq_pending; // pod_manager_set_frequency waiting for the poll side
+    uint16_t freq_request;      // period and prescaler, as in pod_meta_t
+    uint8_t freq_request_prescale;
+    uint16_t due;      // poll clock at which the bay is next serviced
+    volatile bool fire_pending; // pod_manager_fire waiting for verification
+    uint8_t fire_next;          // fire_wave[] entry pending or last started
+    uint16_t fire_duration_ms;
+    relay_wave_t fire_wave[2];  // compiled by pod_manager_fire; one may be playing
+    bool firing;       // fire in progress, fire_left_ms to go as of fire_mark
+    uint16_t fire_left_ms;
+    uint16_t fire_mark;
+    pod_port_t port;
+    uint8_t buf[POD_EEPROM_BLOCK_SIZE];
+    pod_snapshot_t snap[2];     // front is snap[snap_seq & 1]
+    volatile uint8_t snap_seq;  // bumped once per publish
+} pod_t;
+
+// Bays holding one scent (bit n = bay n)
+typedef struct
+{
+    uint16_t scent;
+    uint8_t bays;
+} pod_route_t;
+
+/**
+ * Metadata of a removed pod, including the not yet written back usage.
+ * The generation probe still catches a pod rewritten while it was out.
+ */
+typedef struct
+{
+    bool valid;
+    uint8_t stamp;     // LRU clock at the time of caching
+    uint8_t watch_gen;
+    uint16_t uid_hash;
+    uint16_t unsaved;
+    uint32_t dose;
+    uint16_t last_use;
+    bool freq_dirty;
+    pod_meta_t meta;
+    pod_stats_t stats;
+} pod_cache_entry_t;
+
+/**
+ * Lookup index over the active bays, rebuilt by the completion handlers
+ * whenever a pod is inserted, removed or re-read. UIDs are matched on a CRC-16 hash
+ * first; the full 16 bytes are only compared on a hash hit.
+ */
+typedef struct
+{
+    uint16_t uid_hash[POD_BAY_COUNT];
+    uint8_t uid_bays; // bays with a valid uid_hash entry
+    pod_route_t routes[POD_BAY_COUNT];
+    uint8_t route_count;
+} pod_index_t;
 
 typedef struct
 {
-    i2c_async_t *i2c;
     pod_t pods[POD_BAY_COUNT];
-    uint32_t last_poll_ms;
+    uint8_t insert_debounce;
+    uint8_t remove_debounce;
+    uint16_t low_remaining;
+    pod_event_cb_t event_cb;
+    void *event_ctx;
+    pod_index_t index;
+    pod_cache_entry_t cache[POD_CACHE_ENTRIES]; // completion handlers only
+    uint8_t cache_clock;
+    volatile uint16_t now; // poll clock in ms, advanced by pod_manager_poll
+    uint8_t slot;          // bay owning the next poll slot
 } pod_manager_t;
 
+// Same engine either way: the async transport completes from the I2C ISR,
+// the blocking one inside pod_manager_poll
 void pod_manager_init(pod_manager_t *pm, i2c_async_t *bus);
-void pod_manager_poll(pod_manager_t *pm); // called ~100 ms
-void pod_manager_tick_100ms(void);        // Timer ISR entry point
+void pod_manager_init_blocking(pod_manager_t *pm, i2c_t *bus);
+void pod_manager_set_debounce(pod_manager_t *pm, uint8_t insert_polls, uint8_t remove_polls);
+void pod_manager_set_low_threshold(pod_manager_t *pm, uint16_t remaining);
+void pod_manager_set_event_cb(pod_manager_t *pm, pod_event_cb_t cb, void *ctx);
+void pod_manager_poll(pod_manager_t *pm);
+// Lock-free, tear-free reads of a bay's state from any context. The other
+// pod_t fields belong to the poll/ISR side and may be mid-update.
+void pod_manager_snapshot(const pod_manager_t *pm, uint8_t bay, pod_snapshot_t *out);
+bool pod_manager_is_active(const pod_manager_t *pm, uint8_t bay);
+
+// Writes back everything held in RAM (volume, frequency, usage stats) at
+// each seated pod's next verification poll, whatever the thresholds say.
+// Before power-down: call it, then keep polling until pod_manager_flushed.
+void pod_manager_flush(pod_manager_t *pm);
+bool pod_manager_flushed(const pod_manager_t *pm);
+
+// Queues the fire; it starts once the bay's next slot probe ACKs (within
+// POD_POLL_PERIOD_MS) and is dropped if the pod has gone. _level takes a
+// Q8 intensity (RELAY_LEVEL) for duty steps finer than a whole point.
+void pod_manager_fire(pod_manager_t *pm, uint8_t bay, uint16_t duration_ms, uint8_t intensity);
+void pod_manager_fire_level(pod_manager_t *pm, uint8_t bay, uint16_t duration_ms, uint16_t level);
+
+// Carrier frequency in Hz (0 = board default), planned into a period and
+// prescaler by relay_pwm_plan, applied to the bay's fires from its next
+// slot on and written back to the pod; false if out of reach. Calibration:
+// sweep, then pick the period running when the output looked best; the
+// pick stops the sweep and records it. The pick fails, leaving the channel
+// alone, unless that bay's own sweep is still running.
+bool pod_manager_set_frequency(pod_manager_t *pm, uint8_t bay, uint32_t freq_hz);
+bool pod_manager_calibrate(pod_manager_t *pm, uint8_t bay, const relay_sweep_t *sweep);
+bool pod_manager_calibrate_pick(pod_manager_t *pm, uint8_t bay);
+
+// Index lookups (safe against a concurrent rebuild)
+bool pod_manager_find_uid(pod_manager_t *pm, const uint8_t *uid, uint8_t *bay);
+uint8_t pod_manager_scent_bays(pod_manager_t *pm, uint16_t scent);
+// Fires the fullest active bay holding scent; false if none has any left.
+// Timed programs go through relay_pwm_queue() with RELAY_POD_SCENT steps,
+// which the manager resolves the same way at the start of each step.
+bool pod_manager_fire_scent(pod_manager_t *pm, uint16_t scent, uint16_t duration_ms, uint8_t intensity);
 
-#endif /* __POD_MANAGER_H__ */
+#endif
@@ -0,0 +1,192 @@
+#include "pod_record.h"
+#include <string.h>
+#include "crc16.h"
+
+static inline uint16_t u16_from_buf(const uint8_t *b)
+{
+    return ((uint16_t)b[0] << 8) | b[1];
+}
+
+static inline void u16_to_buf(uint8_t *b, uint16_t v)
+{
+    b[0] = (uint8_t)(v >> 8);
+    b[1] = (uint8_t)v;
+}
+
+// Size-dispatched field access; the size is a constant so the ternary folds
+// away and each generated load/store is straight-line code.
+#define REC_GET(rec, name) \
+    ((POD_REC_##name##_SIZE == 1) ? (uint16_t)(rec)[POD_REC_##name] : u16_from_buf(&(rec)[POD_REC_##name]))
+#define REC_PUT(rec, name, v)                        \
+    do                                               \
+    {                                                \
+        if (POD_REC_##name##_SIZE == 1)              \
+            (rec)[POD_REC_##name] = (uint8_t)(v);    \
+        else                                         \
+            u16_to_buf(&(rec)[POD_REC_##name], (v)); \
+    } while (0)
+
+static uint16_t record_crc(const uint8_t *uid, const uint8_t *rec)
+{
+    uint16_t crc = crc16_update(CRC16_INIT, uid, POD_UID_SIZE);
+    return crc16_update(crc, rec, POD_REC_CRC);
+}
+
+static bool record_valid(const uint8_t *uid, const uint8_t *rec)
+{
+    // Older writers are fine: fields they lack read back as 0xFF.. defaults
+    return rec[POD_REC_VERSION] >= 1 && rec[POD_REC_VERSION] <= POD_RECORD_VERSION &&
+           u16_from_buf(&rec[POD_REC_CRC]) == record_crc(uid, rec);
+}
+
+// A legacy pod has a programmed UID and nothing past POD_LEGACY_SIZE; a
+// record image with both slots corrupt fails the erased check
+static bool legacy_valid(const uint8_t *image)
+{
+    bool blank = true;
+    for (uint8_t i = POD_UID_ADDR; i < POD_UID_ADDR + POD_UID_SIZE; i++)
+    {
+        blank = blank && image[i] == 0xFF;
+    }
+    if (blank)
+    {
+        return false;
+    }
+    for (uint8_t i = POD_LEGACY_SIZE; i < POD_RECORD_IMAGE_SIZE; i++)
+    {
+        if (image[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+pod_record_status_t pod_record_decode(const uint8_t *image, pod_meta_t *m)
+{
+    const uint8_t *uid = &image[POD_UID_ADDR];
+    const uint8_t *a = &image[POD_RECORD_SLOT_A];
+    const uint8_t *b = &image[POD_RECORD_SLOT_B];
+    bool a_ok = record_valid(uid, a);
+    bool b_ok = record_valid(uid, b);
+
+    uint8_t slot;
+    if (a_ok && b_ok)
+    {
+        slot = ((int8_t)(b[POD_REC_GENERATION] - a[POD_REC_GENERATION]) > 0) ? 1 : 0;
+    }
+    else if (a_ok)
+    {
+        slot = 0;
+    }
+    else if (b_ok)
+    {
+        slot = 1;
+    }
+    else if (legacy_valid(image))
+    {
+        memcpy(m->uid, &image[POD_UID_ADDR], POD_UID_SIZE);
+        m->scent = u16_from_buf(&image[POD_LEGACY_SCENT]);
+        m->remaining = u16_from_buf(&image[POD_LEGACY_REMAINING]);
+        m->frequency = 0xFFFF; // fields the layout never had: unset
+        m->prescale = 0xFF;
+        m->generation = 0xFF;
+        m->slot = 1;
+        return POD_RECORD_LEGACY;
+    }
+    else
+    {
+        return POD_RECORD_INVALID;
+    }
+
+    const uint8_t *rec = slot ? b : a;
+    memcpy(m->uid, uid, POD_UID_SIZE);
+#define DECODE(name, member) m->member = REC_GET(rec, name);
+    POD_META_FIELDS(DECODE)
+#undef DECODE
+    m->generation = rec[POD_REC_GENERATION];
+    m->slot = slot;
+    return POD_RECORD_OK;
+}
+
+bool pod_record_matches(const uint8_t *uid, const uint8_t *rec, uint8_t generation, uint16_t remaining)
+{
+    return record_valid(uid, rec) && rec[POD_REC_GENERATION] == generation && REC_GET(rec, REMAINING) == remaining;
+}
+
+uint16_t pod_record_encode_next(const pod_meta_t *m, uint8_t *rec)
+{
+    memset(rec, 0xFF, POD_RECORD_SIZE);
+    rec[POD_REC_VERSION] = POD_RECORD_VERSION;
+    rec[POD_REC_GENERATION] = (uint8_t)(m->generation + 1);
+#define ENCODE(name, member) REC_PUT(rec, name, m->member);
+    POD_META_FIELDS(ENCODE)
+#undef ENCODE
+    u16_to_buf(&rec[POD_REC_CRC], record_crc(m->uid, rec));
+    return pod_record_slot_addr(m->slot ^ 1);
+}
+
+void pod_record_commit(pod_meta_t *m)
+{
+    m->generation++;
+    m->slot ^= 1;
+}
+
+// ------------------------------------------------------------
+// Usage stats
+// ------------------------------------------------------------
+static inline uint32_t u24_from_buf(const uint8_t *b)
+{
+    return ((uint32_t)b[0] << 16) | ((uint32_t)b[1] << 8) | b[2];
+}
+
+static inline void u24_to_buf(uint8_t *b, uint32_t v)
+{
+    if (v > POD_STATS_COUNT_MAX)
+    {
+        v = POD_STATS_COUNT_MAX;
+    }
+    b[0] = (uint8_t)(v >> 16);
+    b[1] = (uint8_t)(v >> 8);
+    b[2] = (uint8_t)v;
+}
+
+static uint16_t stats_crc(const uint8_t *uid, const uint8_t *slot)
+{
+    uint16_t crc = crc16_update(CRC16_INIT, uid, POD_UID_SIZE);
+    return crc16_update(crc, slot, POD_STATS_SLOT_SIZE - 2);
+}
+
+bool pod_stats_decode(const uint8_t *uid, const uint8_t *area, pod_stats_t *s, uint8_t *slot)
+{
+    bool found = false;
+    s->fires = 0;
+    s->used = 0;
+    *slot = 1;
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        const uint8_t *b = &area[i * POD_STATS_SLOT_SIZE];
+        if (u16_from_buf(&b[POD_STATS_SLOT_SIZE - 2]) != stats_crc(uid, b))
+        {
+            continue;
+        }
+        uint32_t fires = u24_from_buf(&b[0]);
+        uint32_t used = u24_from_buf(&b[3]);
+        if (!found || fires + used > s->fires + s->used)
+        {
+            s->fires = fires;
+            s->used = used;
+            *slot = i;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void pod_stats_encode(const uint8_t *uid, const pod_stats_t *s, uint8_t *out)
+{
+    u24_to_buf(&out[0], s->fires);
+    u24_to_buf(&out[3], s->used);
+    u16_to_buf(&out[POD_STATS_SLOT_SIZE - 2], stats_crc(uid, out));
+}
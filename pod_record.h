@@ -0,0 +1,181 @@
+/**
+ * @file pod_record.h
+ * @author Walt
+ * @brief CRC-protected A/B pod metadata records
+ * @version 0.1
+ * @date 2025-10-22
+ *
+ * @copyright Copyright (c) 2025
+ *
+ * Pod EEPROM layout:
+ *  0x00-0x0F : 128-bit Unique ID (factory programmed, never rewritten)
+ *  0x10-0x1F : metadata record, slot A
+ *  0x20-0x2F : metadata record, slot B
+ *  0x30-0x3F : usage stats, slots A and B (8 bytes each, see pod_stats_t)
+ *
+ * Record (16 bytes): see POD_RECORD_FIELDS below, the single source of
+ * truth for offsets. Multi-byte fields are big-endian. The CRC is
+ * CRC-16/CCITT over UID + every record byte before it.
+ *
+ * The newest slot with a good CRC is active. Updates always go to the other
+ * slot with generation + 1, so a torn write leaves the active copy intact.
+ * UID and both slots are contiguous and load in one sequential read.
+ */
+
+#ifndef __POD_RECORD_H__
+#define __POD_RECORD_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define POD_UID_ADDR 0x00
+#define POD_UID_SIZE 16
+#define POD_RECORD_SIZE 16
+#define POD_RECORD_SLOT_A 0x10
+#define POD_RECORD_SLOT_B 0x20
+#define POD_RECORD_IMAGE_SIZE 0x30 // UID + both slots
+
+/**
+ * Record schema. X(NAME, offset, size, since_version)
+ *
+ * New fields are only ever carved out of RESERVED. Reserved bytes are
+ * written as 0xFF, so a field read from a record older than its
+ * since_version decodes as all-ones ("unset") with no version branch.
+ *
+ *  VERSION    schema version of the writer
+ *  GENERATION uint8, wraps; newer = (int8_t)(a - b) > 0
+ *  SCENT      scent ID
+ *  REMAINING  remaining volume (0xffff = full)
+ *  FREQUENCY  PWM period in MCCP counts (0xffff = board default)
+ *  PRESCALE   MCCP prescaler for FREQUENCY, CCPxCON1L.TMRPS (0xff = 1:1,
+ *             as read from records older than version 3)
+ */
+#define POD_RECORD_VERSION 3
+
+#define POD_RECORD_FIELDS(X) \
+    X(VERSION, 0, 1, 1)      \
+    X(GENERATION, 1, 1, 1)   \
+    X(SCENT, 2, 2, 1)        \
+    X(REMAINING, 4, 2, 1)    \
+    X(FREQUENCY, 6, 2, 2)    \
+    X(PRESCALE, 8, 1, 3)     \
+    X(RESERVED, 9, 5, 1)     \
+    X(CRC, 14, 2, 1)
+
+// Fields copied to/from pod_meta_t. F(NAME, member)
+#define POD_META_FIELDS(F) \
+    F(SCENT, scent)        \
+    F(REMAINING, remaining) \
+    F(FREQUENCY, frequency) \
+    F(PRESCALE, prescale)
+
+// Generated offsets and sizes: POD_REC_<NAME>, POD_REC_<NAME>_SIZE
+enum
+{
+#define POD_REC_ENUM(name, ofs, size, since) POD_REC_##name = (ofs), POD_REC_##name##_SIZE = (size),
+    POD_RECORD_FIELDS(POD_REC_ENUM)
+#undef POD_REC_ENUM
+};
+
+// Packed mirror of the schema; the asserts below prove it has no gaps or
+// overlaps and ends exactly at the CRC.
+typedef struct __attribute__((packed))
+{
+#define POD_REC_MEMBER(name, ofs, size, since) uint8_t name[size];
+    POD_RECORD_FIELDS(POD_REC_MEMBER)
+#undef POD_REC_MEMBER
+} pod_record_layout_t;
+
+#define POD_REC_CHECK(name, ofs, size, since)                              \
+    _Static_assert(__builtin_offsetof(pod_record_layout_t, name) == (ofs), \
+                   "pod record field " #name " offset");                   \
+    _Static_assert((since) <= POD_RECORD_VERSION, "pod record field " #name " version");
+POD_RECORD_FIELDS(POD_REC_CHECK)
+#undef POD_REC_CHECK
+#define POD_META_CHECK(name, member) \
+    _Static_assert(POD_REC_##name##_SIZE <= 2, "pod meta field " #name " too wide");
+POD_META_FIELDS(POD_META_CHECK)
+#undef POD_META_CHECK
+_Static_assert(sizeof(pod_record_layout_t) == POD_RECORD_SIZE, "pod record size");
+_Static_assert(POD_REC_CRC + POD_REC_CRC_SIZE == POD_RECORD_SIZE, "CRC must end the record");
+_Static_assert(POD_RECORD_SLOT_B - POD_RECORD_SLOT_A >= POD_RECORD_SIZE, "record slots overlap");
+
+typedef struct
+{
+    uint8_t uid[POD_UID_SIZE]; // unique identifier
+    uint16_t scent;            // scent ID
+    uint16_t remaining;        // remaining volume
+    uint16_t frequency;        // PWM period, 0xffff = board default
+    uint8_t prescale;          // its MCCP prescaler, 0xff = 1:1
+    uint8_t generation;        // generation of the active slot
+    uint8_t slot;              // active slot (0 = A, 1 = B)
+} pod_meta_t;
+
+static inline uint16_t pod_record_slot_addr(uint8_t slot)
+{
+    return slot ? POD_RECORD_SLOT_B : POD_RECORD_SLOT_A;
+}
+
+/**
+ * Pre-record layout: the 22 bytes the original firmware read, scent and
+ * remaining straight after the UID with no CRC, the rest of the image
+ * still erased. Decoded as an active slot B at generation 0xFF, so the
+ * first write-back migrates it into slot A at generation 0.
+ */
+#define POD_LEGACY_SCENT 0x10
+#define POD_LEGACY_REMAINING 0x12
+#define POD_LEGACY_SIZE 22
+
+typedef enum
+{
+    POD_RECORD_OK,      // newest valid slot decoded
+    POD_RECORD_LEGACY,  // pre-record layout decoded, not yet migrated
+    POD_RECORD_INVALID  // blank or corrupt: nothing decoded
+} pod_record_status_t;
+
+// Validate both slots of a POD_RECORD_IMAGE_SIZE image and decode the newest
+// (or the legacy layout when neither slot holds a record)
+pod_record_status_t pod_record_decode(const uint8_t *image, pod_meta_t *m);
+
+// True if the single slot rec is valid for uid and still holds this
+// generation and remaining volume
+bool pod_record_matches(const uint8_t *uid, const uint8_t *rec, uint8_t generation, uint16_t remaining);
+
+// Encode m into rec as the next generation; returns the inactive slot address
+uint16_t pod_record_encode_next(const pod_meta_t *m, uint8_t *rec);
+
+// Call once the record from pod_record_encode_next is safely written
+void pod_record_commit(pod_meta_t *m);
+
+/**
+ * Usage stats: lifetime fires and units of volume used, kept apart from
+ * the record because they change with every fire. Each slot is a 24-bit
+ * big-endian fire count, a 24-bit units count, then CRC-16/CCITT over
+ * UID + both counts. The counts only ever grow (and saturate), so the
+ * valid slot with the larger total is the newest and updates go to the
+ * other one: a torn write loses at most the counts it carried. A slot is
+ * 8 bytes and 8-aligned, inside one page on every supported part.
+ */
+#define POD_STATS_ADDR 0x30
+#define POD_STATS_SLOT_SIZE 8
+#define POD_STATS_SIZE (2 * POD_STATS_SLOT_SIZE)
+#define POD_STATS_COUNT_MAX 0xFFFFFFUL
+
+_Static_assert(POD_STATS_ADDR >= POD_RECORD_IMAGE_SIZE, "stats overlap the records");
+_Static_assert(POD_STATS_ADDR % POD_STATS_SLOT_SIZE == 0, "stats slots must not straddle a page");
+
+typedef struct
+{
+    uint32_t fires; // fires started
+    uint32_t used;  // units of pod_meta_t.remaining used, refills included
+} pod_stats_t;
+
+// Decode the newest valid slot of the POD_STATS_SIZE area into s and its
+// index into slot; false (s zeroed, slot 1 so slot A is written first) if
+// neither slot is valid
+bool pod_stats_decode(const uint8_t *uid, const uint8_t *area, pod_stats_t *s, uint8_t *slot);
+
+// Encode s into one POD_STATS_SLOT_SIZE slot
+void pod_stats_encode(const uint8_t *uid, const pod_stats_t *s, uint8_t *out);
+
+#endif
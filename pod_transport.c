@@ -0,0 +1,107 @@
+#include "pod_transport.h"
+
+// ------------------------------------------------------------
+// Async transport: thin wrappers over eeprom_async
+// ------------------------------------------------------------
+static bool pod_async_probe(pod_port_t *port, eeproma_callback_t cb, void *ctx)
+{
+    return eeproma_probe_async(&port->u.async.dev, cb, ctx);
+}
+
+static bool pod_async_read(pod_port_t *port, uint16_t addr, uint8_t *buf, uint8_t len,
+                           eeproma_callback_t cb, void *ctx)
+{
+    return eeproma_read_block_async(&port->u.async.dev, addr, buf, len, cb, ctx);
+}
+
+static bool pod_async_write(pod_port_t *port, uint16_t addr, const uint8_t *buf, uint8_t len,
+                            eeproma_callback_t cb, void *ctx)
+{
+    return eeproma_write_block_async(&port->u.async.dev, &port->u.async.wr, addr, buf, len, cb, ctx);
+}
+
+static void pod_async_forget_addr(pod_port_t *port)
+{
+    eeproma_forget_addr(&port->u.async.dev);
+}
+
+static const pod_transport_t POD_TRANSPORT_ASYNC = {
+    pod_async_probe, pod_async_read, pod_async_write, pod_async_forget_addr};
+
+// ------------------------------------------------------------
+// Blocking transport: runs the transfer, then the callback, in the
+// caller's context
+// ------------------------------------------------------------
+static bool pod_blocking_complete(eeprom_result_t res, eeproma_callback_t cb, void *ctx)
+{
+    eeproma_result_t r;
+
+    switch (res)
+    {
+    case EEPROM_OK:
+        r = EEPROMA_OK;
+        break;
+    case EEPROM_ERR_I2C:
+    case EEPROM_ERR_NACK:
+        r = EEPROMA_ERR_NACK;
+        break;
+    case EEPROM_ERR_RANGE:
+        return false; // a bad request, same as a rejected async submit
+    default:
+        r = EEPROMA_ERR_TIMEOUT;
+        break;
+    }
+    if (cb)
+    {
+        cb(ctx, r);
+    }
+    return true;
+}
+
+static bool pod_blocking_probe(pod_port_t *port, eeproma_callback_t cb, void *ctx)
+{
+    const eeprom_t *e = &port->u.blocking;
+    eeprom_result_t res = EEPROM_ERR_TIMEOUT;
+
+    if (i2c_start(e->bus) == I2C_OK)
+    {
+        res = (i2c_write_byte(e->bus, (e->address << 1) | 0) == I2C_OK) ? EEPROM_OK : EEPROM_ERR_NACK;
+        i2c_stop(e->bus);
+    }
+    return pod_blocking_complete(res, cb, ctx);
+}
+
+static bool pod_blocking_read(pod_port_t *port, uint16_t addr, uint8_t *buf, uint8_t len,
+                              eeproma_callback_t cb, void *ctx)
+{
+    return pod_blocking_complete(eeprom_read_block(&port->u.blocking, addr, buf, len), cb, ctx);
+}
+
+static bool pod_blocking_write(pod_port_t *port, uint16_t addr, const uint8_t *buf, uint8_t len,
+                               eeproma_callback_t cb, void *ctx)
+{
+    return pod_blocking_complete(eeprom_write_block(&port->u.blocking, addr, buf, len), cb, ctx);
+}
+
+static void pod_blocking_forget_addr(pod_port_t *port)
+{
+    eeprom_forget_addr(&port->u.blocking);
+}
+
+static const pod_transport_t POD_TRANSPORT_BLOCKING = {
+    pod_blocking_probe, pod_blocking_read, pod_blocking_write, pod_blocking_forget_addr};
+
+// ------------------------------------------------------------
+// Public API
+// ------------------------------------------------------------
+void pod_port_init_async(pod_port_t *port, i2c_async_t *bus, uint8_t address)
+{
+    port->ops = &POD_TRANSPORT_ASYNC;
+    eeproma_init(&port->u.async.dev, bus, address);
+}
+
+void pod_port_init_blocking(pod_port_t *port, i2c_t *bus, uint8_t address)
+{
+    port->ops = &POD_TRANSPORT_BLOCKING;
+    eeprom_init(&port->u.blocking, bus, address);
+}
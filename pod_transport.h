@@ -0,0 +1,77 @@
+/**
+ * @file pod_transport.h
+ * @author Walt
+ * @brief EEPROM transport behind the pod manager (blocking or async)
+ * @version 0.1
+ * @date 2025-10-22
+ *
+ * @copyright Copyright (c) 2025
+ *
+ * Both transports report through eeproma_callback_t. The async one
+ * completes from the I2C ISR; the blocking one runs the transfer and the
+ * callback before the submit returns, so the pod manager has a single
+ * completion path either way.
+ */
+
+#ifndef __POD_TRANSPORT_H__
+#define __POD_TRANSPORT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <xc.h>
+#include <libpic30.h>
+#include "eeprom.h"
+#include "eeprom_async.h"
+
+typedef struct pod_port pod_port_t;
+
+typedef struct
+{
+    bool (*probe)(pod_port_t *port, eeproma_callback_t cb, void *ctx);
+    bool (*read)(pod_port_t *port, uint16_t addr, uint8_t *buf, uint8_t len, eeproma_callback_t cb, void *ctx);
+    bool (*write)(pod_port_t *port, uint16_t addr, const uint8_t *buf, uint8_t len, eeproma_callback_t cb,
+                  void *ctx);
+    void (*forget_addr)(pod_port_t *port);
+} pod_transport_t;
+
+// One per bay, statically embedded in pod_t
+struct pod_port
+{
+    const pod_transport_t *ops;
+    union
+    {
+        struct
+        {
+            eeproma_t dev;
+            eeproma_write_t wr;
+        } async;
+        eeprom_t blocking;
+    } u;
+};
+
+void pod_port_init_async(pod_port_t *port, i2c_async_t *bus, uint8_t address);
+void pod_port_init_blocking(pod_port_t *port, i2c_t *bus, uint8_t address);
+
+static inline bool pod_port_probe(pod_port_t *port, eeproma_callback_t cb, void *ctx)
+{
+    return port->ops->probe(port, cb, ctx);
+}
+
+static inline bool pod_port_read(pod_port_t *port, uint16_t addr, uint8_t *buf, uint8_t len,
+                                 eeproma_callback_t cb, void *ctx)
+{
+    return port->ops->read(port, addr, buf, len, cb, ctx);
+}
+
+static inline bool pod_port_write(pod_port_t *port, uint16_t addr, const uint8_t *buf, uint8_t len,
+                                  eeproma_callback_t cb, void *ctx)
+{
+    return port->ops->write(port, addr, buf, len, cb, ctx);
+}
+
+static inline void pod_port_forget_addr(pod_port_t *port)
+{
+    port->ops->forget_addr(port);
+}
+
+#endif /* __POD_TRANSPORT_H__ */
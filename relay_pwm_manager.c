@@ -1,9 +1,43 @@
 #include "relay_pwm_manager.h"
+#include <stddef.h>
 
 #define FCY 16000000UL
 
 #define FREQ_DEFAULT 93
 
+// Accepted carrier periods in MCCP counts (Tcy / period: 1 MHz .. 244 Hz
+// at 1:1, down to ~4 Hz with the planner's prescalers)
+#define RELAY_PERIOD_MIN 16u
+#define RELAY_PERIOD_MAX 0xFFFEu
+
+// Intensity that is 100 % duty
+#define RELAY_DUTY_FULL_SCALE ((uint16_t)RELAY_INTENSITY_MAX)
+
+// MCCP timer prescalers by CCPxCON1L.TMRPS. Tcy is the only clock source
+// wired up here, so the finest resolution for a frequency is the smallest
+// prescaler whose period still fits in 16 bits.
+static const uint8_t RELAY_PRESCALE_SHIFT[4] = {0, 2, 4, 6}; // 1:1, 1:4, 1:16, 1:64
+
+// Pulse envelope generators (SCCP4 gates MCCP2, SCCP5 gates MCCP3). Their
+// timebase is the reference clock, REFO = FOSC / (2 * RELAY_ENV_REFO_DIV)
+// = 128 kHz kept off the pin, at 1:16: 8 ticks per ms, so pulse periods up
+// to 8 s (the legacy 1 s pattern included) are gated in hardware. If
+// env_clock_pick cannot find REFO among the SCCP clock inputs they stay on
+// Tcy/64 like Timer4 (periods up to 262 ms). Longer periods, or all of
+// them when env_probe finds no shutdown source, are sequenced in software.
+#define RELAY_ENV_REFO_DIV 125u
+#define RELAY_ENV_TMRPS 0b10 // 1:16
+#define RELAY_ENV_TICKS_PER_MS ((uint16_t)(FCY / RELAY_ENV_REFO_DIV / 16UL / 1000UL))
+// Timebase measurement window (busy wait at init)
+#define RELAY_ENV_CLOCK_PROBE_MS 8
+// Settling time per step of the envelope source probe (several envelope
+// and carrier periods)
+#define RELAY_PROBE_US 50
+
+// Timer4 event timebase
+#define RELAY_TICKS_PER_MS (FCY / 64UL / 1000UL)
+#define RELAY_SPAN_MAX_MS ((uint16_t)(0xFFFFUL / RELAY_TICKS_PER_MS))
+
 #define UART1RXPIN 26 // RG7 (RP26)
 #define UART1TXPIN 21 // RG6 (RP21)
 
@@ -27,11 +61,65 @@ static const relay_pin_t RELAYS[6] = {
     {&TRISF, &LATF, (1u << 1)}  // 3L
 };
 
-static uint8_t active_pod = 0xFF;
-static uint8_t pulse_intensity = 100;
-static uint16_t pulse_duration_ms = 0;
-static uint16_t pulse_timer_ms = 0;
-static bool pulse_on = false;
+// Queued sequencer step, compiled by relay_pwm_queue so the ISR only loads it
+typedef struct
+{
+    relay_step_t step;
+    relay_wave_t wave; // no segments: the step plays as silence
+} relay_queued_t;
+
+/**
+ * One pulsing channel per MCCP: RIGHT (MCCP2, pods 0-2) and LEFT (MCCP3,
+ * pods 3-5). Each runs its own fire and its own step queue, so one pod per
+ * side can fire at the same time.
+ */
+typedef struct
+{
+    volatile uint8_t pod; // firing pod, 0xFF when idle
+    uint8_t closed;       // pod whose relay is closed, 0xFF if all open
+    uint16_t relay_ms;    // contacts moving: dead time after an open, settle after a close
+    const relay_wave_t *wave; // compiled fire stepped by the ISR: own or a queue slot
+    relay_wave_t own;         // direct fires and sweeps
+    uint8_t seg;              // current segment
+    uint16_t seg_left_ms;
+    uint16_t loops;           // completed passes of the current loop
+    uint16_t level;           // Q8 intensity charged for the time being driven
+    volatile uint16_t period; // carrier period currently driven
+    uint32_t scale;           // its duty scale (relay_plan_t.scale)
+    uint8_t tmrps;
+    bool sweeping;            // the fire is a calibration sweep of pod
+
+    // Step queue (single producer: caller, single consumer: Timer4 ISR).
+    // A playing step keeps its slot, at tail, until it ends.
+    relay_queued_t queue[RELAY_SEQ_DEPTH];
+    volatile uint8_t head; // written by relay_pwm_queue
+    volatile uint8_t tail; // written by the ISR
+    bool seq_playing;      // queue[tail] is the fire playing
+    volatile uint16_t gap_ms;
+} relay_channel_t;
+
+static relay_channel_t channels[RELAY_CHANNEL_COUNT];
+static uint16_t t4_span_ms = 0; // ms the running Timer4 period covers, 0 = stopped
+static uint16_t relay_dead_ms = RELAY_DEAD_MS_DEFAULT;
+static uint16_t relay_settle_ms = RELAY_SETTLE_MS_DEFAULT;
+static relay_resolve_cb_t seq_resolve = NULL;
+static void *seq_resolve_ctx = NULL;
+
+// Accumulated dose per pod in intensity*ms, drained by relay_pwm_take_dose
+static volatile uint32_t pod_dose[6];
+// Fires started per pod, drained by relay_pwm_take_fires
+static volatile uint16_t pod_fires[6];
+
+// Carrier per pod, set from the pod metadata (relay_pwm_set_carrier)
+static relay_plan_t pod_plan[6];
+
+// CCPxCON2L.ASDG source that carries each channel's envelope to its carrier,
+// found by env_probe. Without both, pulse trains are sequenced in software.
+static uint8_t env_asdg[RELAY_CHANNEL_COUNT];
+static bool env_hw = false;
+// Envelope timebase, set by env_clock_pick
+static uint16_t env_ticks_per_ms = RELAY_TICKS_PER_MS;
+static uint16_t env_max_ms = RELAY_SPAN_MAX_MS;
 
 // ------------------------------------------------------------
 // Relay control
@@ -46,6 +134,14 @@ static inline void relay_off(uint8_t pod)
     *RELAYS[pod].lat &= ~RELAYS[pod].mask;
 }
 
+static inline void channel_relays_off(uint8_t ch)
+{
+    for (uint8_t i = ch * RELAY_PODS_PER_CHANNEL; i < (ch + 1u) * RELAY_PODS_PER_CHANNEL; i++)
+    {
+        relay_off(i);
+    }
+}
+
 static inline void all_relays_off(void)
 {
     for (uint8_t i = 0; i < 6; i++)
@@ -54,6 +150,153 @@ static inline void all_relays_off(void)
     }
 }
 
+// ------------------------------------------------------------
+// Envelope source probe
+//
+// The envelope (SCCP4/5, OCAEN = 0) reaches its carrier only as an internal
+// auto-shutdown source. Rather than trust a table, each ASDG input is tried
+// in turn at init with the relays open: the one whose shutdown event
+// (CCPxSTATL.ASEVT) follows the envelope output, and nothing else, is kept.
+// This also proves the internal signal is seen with the pin disabled.
+// ------------------------------------------------------------
+// Hold the envelope output steady: high (carrier shut down) or low. Raw PWM
+// output never set (RA past the period) or never cleared (RB past it),
+// inverted by POLACE.
+static void env_force(uint8_t ch, bool shut)
+{
+    if (ch == RELAY_CHANNEL_RIGHT)
+    {
+        CCP4CON1Lbits.CCPON = 0;
+        CCP4TMRL = 0;
+        CCP4PRL = 1;
+        CCP4RA = shut ? 2 : 0;
+        CCP4RB = 2;
+        CCP4CON1Lbits.CCPON = 1;
+    }
+    else
+    {
+        CCP5CON1Lbits.CCPON = 0;
+        CCP5TMRL = 0;
+        CCP5PRL = 1;
+        CCP5RA = shut ? 2 : 0;
+        CCP5RB = 2;
+        CCP5CON1Lbits.CCPON = 1;
+    }
+}
+
+// Select a carrier shutdown source and clear any event it left behind
+static void env_carrier_source(uint8_t ch, uint8_t asdg)
+{
+    if (ch == RELAY_CHANNEL_RIGHT)
+    {
+        CCP2CON2Lbits.ASDG = asdg;
+        CCP2STATLbits.ASEVT = 0;
+    }
+    else
+    {
+        CCP3CON2Lbits.ASDG = asdg;
+        CCP3STATLbits.ASEVT = 0;
+    }
+}
+
+static bool env_carrier_shut(uint8_t ch)
+{
+    return (ch == RELAY_CHANNEL_RIGHT) ? CCP2STATLbits.ASEVT : CCP3STATLbits.ASEVT;
+}
+
+static uint8_t env_probe(uint8_t ch)
+{
+    uint8_t found = 0;
+
+    // Carrier running at 0 duty into open relays, so events register
+    if (ch == RELAY_CHANNEL_RIGHT)
+    {
+        CCP2CON1Lbits.CCPON = 1;
+    }
+    else
+    {
+        CCP3CON1Lbits.CCPON = 1;
+    }
+
+    for (uint8_t bit = 0; bit < 8 && !found; bit++)
+    {
+        uint8_t asdg = (uint8_t)(1u << bit);
+        env_force(ch, false);
+        __delay_us(RELAY_PROBE_US);
+        env_carrier_source(ch, asdg);
+        __delay_us(RELAY_PROBE_US);
+        if (env_carrier_shut(ch))
+        {
+            continue; // asserted by something else
+        }
+        env_force(ch, true);
+        __delay_us(RELAY_PROBE_US);
+        if (env_carrier_shut(ch))
+        {
+            found = asdg;
+        }
+    }
+
+    if (ch == RELAY_CHANNEL_RIGHT)
+    {
+        CCP4CON1Lbits.CCPON = 0;
+        CCP2CON1Lbits.CCPON = 0;
+    }
+    else
+    {
+        CCP5CON1Lbits.CCPON = 0;
+        CCP3CON1Lbits.CCPON = 0;
+    }
+    env_carrier_source(ch, 0);
+    return found;
+}
+
+// Move the envelopes onto the slow REFO timebase. The CLKSEL input REFO
+// arrives on is found the same way as the shutdown source: each input is
+// run for RELAY_ENV_CLOCK_PROBE_MS and the one that counts at the expected
+// rate (within 1/8) is kept for both SCCPs.
+static void env_clock_pick(void)
+{
+    const uint16_t expect = RELAY_ENV_CLOCK_PROBE_MS * RELAY_ENV_TICKS_PER_MS;
+    uint8_t found = 0;
+
+    REFOCONLbits.ROEN = 0;
+    REFOCONLbits.ROSEL = 0; // FOSC
+    REFOCONLbits.ROOUT = 0; // internal only
+    REFOCONHbits.RODIV = RELAY_ENV_REFO_DIV;
+    REFOCONLbits.ROEN = 1;
+
+    for (uint8_t sel = 1; sel < 8 && !found; sel++)
+    {
+        CCP4CON1Lbits.CCPON = 0;
+        CCP4CON1Lbits.CLKSEL = sel;
+        CCP4CON1Lbits.TMRPS = RELAY_ENV_TMRPS;
+        CCP4PRL = 0xFFFF;
+        CCP4TMRL = 0;
+        CCP4CON1Lbits.CCPON = 1;
+        __delay_ms(RELAY_ENV_CLOCK_PROBE_MS);
+        uint16_t counted = CCP4TMRL;
+        CCP4CON1Lbits.CCPON = 0;
+        if (counted >= expect - expect / 8u && counted <= expect + expect / 8u)
+        {
+            found = sel;
+        }
+    }
+
+    if (!found)
+    {
+        REFOCONLbits.ROEN = 0;
+        CCP4CON1Lbits.CLKSEL = 0b000; // stay on Tcy/64
+        CCP4CON1Lbits.TMRPS = 0b11;
+        return;
+    }
+    CCP4CON1Lbits.CLKSEL = found;
+    CCP5CON1Lbits.CLKSEL = found;
+    CCP5CON1Lbits.TMRPS = RELAY_ENV_TMRPS;
+    env_ticks_per_ms = RELAY_ENV_TICKS_PER_MS;
+    env_max_ms = (uint16_t)(0xFFFFu / RELAY_ENV_TICKS_PER_MS);
+}
+
 // ------------------------------------------------------------
 // Initialize relays and CCP PWM modules
 // ------------------------------------------------------------
@@ -61,6 +304,17 @@ void relay_pwm_init(void)
 {
     uint8_t i;
 
+    for (i = 0; i < RELAY_CHANNEL_COUNT; i++)
+    {
+        channels[i].pod = 0xFF;
+        channels[i].closed = 0xFF;
+        channels[i].relay_ms = 0;
+    }
+    for (i = 0; i < 6; i++)
+    {
+        relay_pwm_plan_period(FREQ_DEFAULT, 0, &pod_plan[i]);
+    }
+
     // --- Relays ---
     for (i = 0; i < 6; i++)
     {
@@ -115,121 +369,1038 @@ void relay_pwm_init(void)
     CCP3CON3Hbits.OUTM = 0b000; // single-ended on OCxA
     CCP3CON2Hbits.OCAEN = 1;    // enable A output
 
-    // --- Timer4 for 1ms tick ---
+    // --- Pulse envelopes: SCCP4/SCCP5 PWM, internal only (no pin) ---
+    // Output inverted so it is high, i.e. shutting the carrier down, during
+    // the off phase of each pulse. The carriers restart on their own when
+    // it drops (gated auto-shutdown), so no software runs per pulse.
+    CCP4CON1Lbits.CCPON = 0;
+    CCP4CON1Lbits.CCSEL = 0;
+    CCP4CON1Lbits.MOD = 0b0101;   // dual-edge PWM
+    CCP4CON1Lbits.CLKSEL = 0b000; // Tcy
+    CCP4CON1Lbits.TMRPS = 0b11;   // 1:64 prescale
+    CCP4CON3Hbits.POLACE = 1;     // active low: high while pulsed off
+    CCP4CON2Hbits.OCAEN = 0;
+
+    CCP5CON1Lbits.CCPON = 0;
+    CCP5CON1Lbits.CCSEL = 0;
+    CCP5CON1Lbits.MOD = 0b0101;
+    CCP5CON1Lbits.CLKSEL = 0b000;
+    CCP5CON1Lbits.TMRPS = 0b11;
+    CCP5CON3Hbits.POLACE = 1;
+    CCP5CON2Hbits.OCAEN = 0;
+
+    CCP2CON2Lbits.ASDGM = 1;     // shutdown follows the source level (and SSDG)
+    CCP2CON3Hbits.PSSACE = 0b10; // output driven low while shut down
+    CCP2CON2Lbits.ASDG = 0;      // no source until a gated segment
+    CCP3CON2Lbits.ASDGM = 1;
+    CCP3CON3Hbits.PSSACE = 0b10;
+    CCP3CON2Lbits.ASDG = 0;
+
+    env_asdg[RELAY_CHANNEL_RIGHT] = env_probe(RELAY_CHANNEL_RIGHT);
+    env_asdg[RELAY_CHANNEL_LEFT] = env_probe(RELAY_CHANNEL_LEFT);
+    env_hw = env_asdg[RELAY_CHANNEL_RIGHT] && env_asdg[RELAY_CHANNEL_LEFT];
+    if (env_hw)
+    {
+        env_clock_pick(); // after the probe, which counts on Tcy/64
+    }
+
+    // --- Timer4: one-shot style event timer, started on demand ---
     T4CON = 0;
     TMR4 = 0;
-    PR4 = (uint16_t)(FCY / 1000UL / 256UL);
-    T4CONbits.TCKPS = 0b11; // 1:256 prescale
-    IEC1bits.T4IE = 1;
+    PR4 = 0xFFFF;
+    T4CONbits.TCKPS = 0b10; // 1:64 prescale, RELAY_TICKS_PER_MS per ms
     IFS1bits.T4IF = 0;
-    T4CONbits.TON = 1;
+    IEC1bits.T4IE = 1;
+    t4_span_ms = 0;
 }
 
 // ------------------------------------------------------------
-// PWM start/stop
+// PWM output (per channel; Timer2 runs while either side is on)
 // ------------------------------------------------------------
-static void pwm_start(uint8_t pod, uint16_t intensity)
+// Duty for a Q8 level from a precomputed plan scale, rounded to the
+// nearest count: whole points, then the fraction, both multiply and shift
+// and safe for the ISR. Their sum stays within scale * RELAY_INTENSITY_MAX,
+// so it cannot overflow, and whole points give the same duty as before.
+static inline uint16_t pwm_duty(uint32_t scale, uint16_t level)
 {
-    uint16_t duty_16 = (uint16_t)((FREQ_DEFAULT * intensity) / 144u);
+    return (uint16_t)((scale * (level >> 8) + (scale >> 8) * (level & 0xFFu) + 0x8000UL) >> 16);
+}
 
-    if (pod < 3)
+// Prescaler changes only take with the module off
+static void pwm_prescale(uint8_t ch, uint8_t tmrps)
+{
+    if (ch == RELAY_CHANNEL_RIGHT)
     {
-        CCP2RB = duty_16;        // falling edge (50% duty)
-        CCP2CON1Lbits.CCPON = 1; // enable MCCP2
+        if (CCP2CON1Lbits.TMRPS != tmrps)
+        {
+            CCP2CON1Lbits.CCPON = 0;
+            CCP2CON1Lbits.TMRPS = tmrps;
+        }
     }
     else
     {
-        CCP3RB = duty_16;
-        CCP3CON1Lbits.CCPON = 1; // enable MCCP3
+        if (CCP3CON1Lbits.TMRPS != tmrps)
+        {
+            CCP3CON1Lbits.CCPON = 0;
+            CCP3CON1Lbits.TMRPS = tmrps;
+        }
     }
+}
 
-    T2CONbits.TON = 1; // enable Timer2 for PWM timebase
+// Stage a new period / duty. The MCCPs run in buffered PWM mode, so the
+// pair is latched at the next period boundary while the module keeps
+// running: no runt pulse and no period restart. Duty 0 holds the output
+// low through the shutdown path (SSDG, PSSACE = driven low) rather than
+// counting on equal edges to give a zero-width pulse; it takes at once, and
+// the output comes back on the next duty.
+static void pwm_update(uint8_t ch, uint16_t period, uint16_t duty)
+{
+    if (ch == RELAY_CHANNEL_RIGHT)
+    {
+        CCP2PRL = period;
+        CCP2RB = duty; // falling edge
+        CCP2CON2Lbits.SSDG = !duty;
+    }
+    else
+    {
+        CCP3PRL = period;
+        CCP3RB = duty;
+        CCP3CON2Lbits.SSDG = !duty;
+    }
 }
 
-static void pwm_stop(void)
+// Module on at the start of a fire, off at its end; nothing in between
+static void pwm_run(uint8_t ch, bool on)
 {
-    CCP2CON1Lbits.CCPON = 0;
-    CCP3CON1Lbits.CCPON = 0;
-    T2CONbits.TON = 0;
+    if (ch == RELAY_CHANNEL_RIGHT)
+    {
+        if (!on)
+        {
+            CCP2RB = 0;
+            CCP2CON2Lbits.SSDG = 0;
+        }
+        CCP2CON1Lbits.CCPON = on; // MCCP2
+    }
+    else
+    {
+        if (!on)
+        {
+            CCP3RB = 0;
+            CCP3CON2Lbits.SSDG = 0;
+        }
+        CCP3CON1Lbits.CCPON = on; // MCCP3
+    }
+
+    // Timer2 is the PWM timebase
+    T2CONbits.TON = CCP2CON1Lbits.CCPON || CCP3CON1Lbits.CCPON;
+}
+
+// Start (w != NULL) or stop the channel's hardware pulse envelope. The
+// envelope restarts at the beginning of its on phase.
+static void env_set(uint8_t ch, const relay_wave_t *w)
+{
+    if (ch == RELAY_CHANNEL_RIGHT)
+    {
+        CCP4CON1Lbits.CCPON = 0;
+        if (w)
+        {
+            CCP4TMRL = 0;
+            CCP4PRL = w->env_period - 1u;
+            CCP4RA = 0;
+            CCP4RB = w->env_on;
+            CCP4CON1Lbits.CCPON = 1;
+        }
+        CCP2CON2Lbits.ASDG = w ? env_asdg[RELAY_CHANNEL_RIGHT] : 0;
+    }
+    else
+    {
+        CCP5CON1Lbits.CCPON = 0;
+        if (w)
+        {
+            CCP5TMRL = 0;
+            CCP5PRL = w->env_period - 1u;
+            CCP5RA = 0;
+            CCP5RB = w->env_on;
+            CCP5CON1Lbits.CCPON = 1;
+        }
+        CCP3CON2Lbits.ASDG = w ? env_asdg[RELAY_CHANNEL_LEFT] : 0;
+    }
 }
 
 // ------------------------------------------------------------
-// Fire a pod?s PWM + relay with pulsing
+// Waveform compiler: fire request -> segment table. Runs in the caller's
+// context (relay_pwm_queue for sequencer steps). The ISR only loads tables
+// and scales each segment's level by the pod's plan: a multiply and shift.
 // ------------------------------------------------------------
-void relay_pwm_fire(uint8_t pod_index, uint16_t duration_ms, uint8_t intensity)
+static void wave_add(relay_wave_t *w, uint16_t ms, uint16_t level)
 {
-    if (pod_index >= 6)
+    if (!ms || w->count >= RELAY_SEG_MAX)
     {
         return;
     }
+    relay_seg_t *sg = &w->seg[w->count++];
+    sg->ms = ms;
+    sg->level = level;
+    sg->charge = level;
+    sg->loop_back = 0;
+    sg->loop_reps = 0;
+    sg->gated = false;
+}
 
-    all_relays_off();
-    relay_on(pod_index);
+// Linear ramp from level `from` to `to` in RELAY_RAMP_STEPS holds
+static void wave_ramp(relay_wave_t *w, uint16_t ms, uint16_t from, uint16_t to)
+{
+    uint16_t done = 0;
+    for (uint8_t k = 1; k <= RELAY_RAMP_STEPS; k++)
+    {
+        uint16_t end = (uint16_t)(((uint32_t)ms * k) / RELAY_RAMP_STEPS);
+        int32_t level = from + ((int32_t)to - from) * k / (RELAY_RAMP_STEPS + 1);
+        wave_add(w, end - done, (uint16_t)level);
+        done = end;
+    }
+}
+
+static void wave_loop(relay_wave_t *w, uint8_t back, uint16_t reps)
+{
+    if (w->count)
+    {
+        w->seg[w->count - 1].loop_back = back;
+        w->seg[w->count - 1].loop_reps = reps;
+    }
+}
+
+// duration_ms == 0 keeps the body running until relay_pwm_stop*
+static void wave_compile(relay_wave_t *w, uint16_t duration_ms, const relay_envelope_t *env)
+{
+    uint16_t level = (env->level > RELAY_LEVEL_MAX) ? RELAY_LEVEL_MAX : env->level;
+    bool forever = (duration_ms == 0);
+    uint16_t ramp = env->ramp_ms;
+    uint16_t tail = forever ? 0 : env->tail_ms;
+    uint16_t body;
+
+    if (!forever)
+    {
+        if (ramp > duration_ms)
+        {
+            ramp = duration_ms;
+        }
+        if (tail > duration_ms - ramp)
+        {
+            tail = duration_ms - ramp;
+        }
+    }
+    body = forever ? 0 : (uint16_t)(duration_ms - ramp - tail);
 
-    pwm_start(pod_index, intensity);
+    w->count = 0;
+    w->period_step = 0;
+    w->scale_step = 0;
+    w->env_on = 0;
+    w->env_period = 0;
+    wave_ramp(w, ramp, 0, level);
 
-    active_pod = pod_index;
-    pulse_intensity = intensity;
-    pulse_duration_ms = duration_ms;
-    pulse_timer_ms = 0;
-    pulse_on = true;
+    if (!env->on_ms || !env->off_ms)
+    {
+        // Continuous
+        if (forever)
+        {
+            wave_add(w, 0xFFFF, level);
+            wave_loop(w, 0, RELAY_LOOP_FOREVER);
+        }
+        else
+        {
+            wave_add(w, body, level);
+        }
+    }
+    else if (env_hw && (uint32_t)env->on_ms + env->off_ms <= env_max_ms)
+    {
+        // Pulse train in hardware: one gated segment for the whole body,
+        // charged at the average level for dose accounting
+        uint16_t period = env->on_ms + env->off_ms;
+        w->env_on = (uint16_t)(env->on_ms * env_ticks_per_ms);
+        w->env_period = (uint16_t)(period * env_ticks_per_ms);
+        wave_add(w, forever ? 0xFFFF : body, level);
+        if (w->count)
+        {
+            relay_seg_t *sg = &w->seg[w->count - 1];
+            sg->gated = true;
+            sg->charge = (uint16_t)(((uint32_t)level * env->on_ms) / period);
+        }
+        if (forever)
+        {
+            wave_loop(w, 0, RELAY_LOOP_FOREVER);
+        }
+    }
+    else
+    {
+        // Slow pulse train sequenced in software, the last period cut short
+        // to land on the duration
+        uint16_t period = env->on_ms + env->off_ms;
+        uint16_t reps = forever ? RELAY_LOOP_FOREVER : body / period;
+        uint16_t rem = forever ? 0 : (uint16_t)(body - reps * period);
+
+        if (reps)
+        {
+            wave_add(w, env->on_ms, level);
+            wave_add(w, env->off_ms, 0);
+            wave_loop(w, 1, reps);
+        }
+        if (rem)
+        {
+            wave_add(w, (rem < env->on_ms) ? rem : env->on_ms, level);
+            wave_add(w, (rem > env->on_ms) ? (uint16_t)(rem - env->on_ms) : 0, 0);
+        }
+    }
+
+    wave_ramp(w, tail, level, 0);
 }
 
-void relay_pwm_stop(void)
+// ISR context: enter the channel's current segment
+static void wave_enter(uint8_t ch)
 {
-    pwm_stop();
-    all_relays_off();
-    active_pod = 0xFF;
-    pulse_duration_ms = 0;
-    pulse_on = false;
+    relay_channel_t *c = &channels[ch];
+    const relay_seg_t *sg = &c->wave->seg[c->seg];
+    c->seg_left_ms = sg->ms;
+    c->level = sg->charge;
+    pwm_update(ch, c->period, sg->level ? pwm_duty(c->scale, sg->level) : 0);
+    env_set(ch, sg->gated ? c->wave : NULL);
 }
 
 // ------------------------------------------------------------
-// Timer4 ISR: handles 1ms tick for pulsing and duration
+// Tickless timebase: Timer4 is programmed for the next channel event
+// (segment end or gap end) and switched off when nothing is pending.
+// All of this runs in the ISR or with interrupts masked.
 // ------------------------------------------------------------
-void __attribute__((interrupt, no_auto_psv)) _T4Interrupt(void)
+static inline void legacy_fire_envelope(relay_envelope_t *env, uint16_t level)
 {
-    IFS1bits.T4IF = 0;
+    env->level = level;
+    env->ramp_ms = 0;
+    env->tail_ms = 0;
+    env->on_ms = (level >= RELAY_LEVEL(100)) ? 1000 : (uint16_t)(((uint32_t)level * 10u) >> 8);
+    env->off_ms = 1000 - env->on_ms;
+}
+
+// ------------------------------------------------------------
+// Break-before-make: the PWM is off whenever a relay moves, a relay only
+// closes once the channel's previous one has had relay_dead_ms to open,
+// and the PWM only starts relay_settle_ms after the close. The waits are
+// timer events like any other, so nothing blocks.
+// ------------------------------------------------------------
+static inline bool channel_driving(const relay_channel_t *c)
+{
+    return c->pod != 0xFF && c->closed == c->pod && !c->relay_ms;
+}
+
+// Start the loaded waveform on a closed, settled relay
+static void channel_drive(uint8_t ch)
+{
+    relay_channel_t *c = &channels[ch];
+    pwm_prescale(ch, c->tmrps);
+    wave_enter(ch);
+    pwm_run(ch, true); // first segment already loaded: starts on a full period
+}
+
+// The channel's relay wait is over: close the pod's relay, or start the PWM
+// once it has settled
+static void relay_ready(uint8_t ch)
+{
+    relay_channel_t *c = &channels[ch];
+    if (c->pod == 0xFF)
+    {
+        return; // dead time after a stop ran out
+    }
+    if (c->closed != c->pod)
+    {
+        relay_on(c->pod);
+        c->closed = c->pod;
+        c->relay_ms = relay_settle_ms;
+        if (c->relay_ms)
+        {
+            return;
+        }
+    }
+    channel_drive(ch);
+}
+
+static inline uint8_t seq_advance(uint8_t i)
+{
+    return (uint8_t)((i + 1u < RELAY_SEQ_DEPTH) ? i + 1u : 0);
+}
+
+// The playing step is over (ended, stopped or replaced): free its slot
+static inline void seq_release(relay_channel_t *c)
+{
+    if (c->seq_playing)
+    {
+        c->seq_playing = false;
+        c->tail = seq_advance(c->tail);
+    }
+}
 
-    if (active_pod == 0xFF)
+// PWM off for the end of a fire; the relay stays closed
+static void channel_end(uint8_t ch)
+{
+    relay_channel_t *c = &channels[ch];
+    env_set(ch, NULL);
+    pwm_run(ch, false);
+    seq_release(c);
+    c->pod = 0xFF;
+    c->sweeping = false;
+    c->level = 0;
+}
+
+// Open the channel's relay (after channel_end) and start its dead time
+static void channel_release(uint8_t ch)
+{
+    relay_channel_t *c = &channels[ch];
+    if (c->closed != 0xFF)
+    {
+        channel_relays_off(ch);
+        c->closed = 0xFF;
+        c->relay_ms = relay_dead_ms;
+    }
+}
+
+// w stays in use until the fire ends: c->own or the queue slot at tail
+static void channel_fire(uint8_t ch, uint8_t pod, const relay_wave_t *w, const relay_plan_t *plan)
+{
+    relay_channel_t *c = &channels[ch];
+    c->wave = w;
+    c->seg = 0;
+    c->loops = 0;
+    c->period = plan->period;
+    c->scale = plan->scale;
+    c->tmrps = plan->tmrps;
+    c->sweeping = false;
+    if (pod < 6 && pod_fires[pod] != 0xFFFF)
+    {
+        pod_fires[pod]++;
+    }
+
+    if (c->closed == pod)
+    {
+        // Relay already closed: change over on a period boundary, or keep
+        // waiting out its settle time
+        c->pod = pod;
+        if (!c->relay_ms)
+        {
+            channel_drive(ch);
+        }
+        return;
+    }
+    channel_end(ch);
+    channel_release(ch);
+    c->pod = pod;
+    if (!c->relay_ms)
+    {
+        relay_ready(ch); // contacts already open long enough
+    }
+}
+
+static void channel_stop(uint8_t ch)
+{
+    channel_end(ch);
+    channel_release(ch);
+}
+
+// Direct fire or sweep from the caller's context (interrupts masked): the
+// table goes into the channel's own slot and replaces whatever is playing
+static void channel_fire_own(uint8_t ch, uint8_t pod, const relay_wave_t *w, const relay_plan_t *plan)
+{
+    relay_channel_t *c = &channels[ch];
+    seq_release(c);
+    c->own = *w;
+    channel_fire(ch, pod, &c->own, plan);
+}
+
+// Start the channel's next queued step, if any. A step whose scent has no
+// pod to fire plays as silence so later steps keep their timing.
+static void seq_start_next(uint8_t ch)
+{
+    relay_channel_t *c = &channels[ch];
+    if (c->seq_playing || c->tail == c->head)
     {
         return;
     }
+    const relay_queued_t *q = &c->queue[c->tail];
+    uint8_t pod = q->step.pod;
+    if (pod == RELAY_POD_SCENT)
+    {
+        pod = seq_resolve ? seq_resolve(seq_resolve_ctx, q->step.scent, ch) : 0xFF;
+    }
 
-    pulse_timer_ms++;
+    if (pod < 6 && relay_pwm_channel(pod) == ch && q->wave.count)
+    {
+        c->gap_ms = q->step.gap_ms;
+        channel_fire(ch, pod, &q->wave, &pod_plan[pod]);
+        c->seq_playing = true; // slot stays taken while the ISR steps it
+    }
+    else
+    {
+        c->gap_ms = q->step.duration_ms + q->step.gap_ms;
+        c->tail = seq_advance(c->tail);
+    }
+}
 
-    uint16_t on_ms = (pulse_intensity * 1000UL) / 100;
-    uint16_t off_ms = 1000UL - on_ms;
+// The current segment has run out: loop back, step on, or end the fire
+static void segment_end(uint8_t ch)
+{
+    relay_channel_t *c = &channels[ch];
+    const relay_seg_t *sg = &c->wave->seg[c->seg];
 
-    if (pulse_on)
+    if (sg->loop_reps && (sg->loop_reps == RELAY_LOOP_FOREVER || ++c->loops < sg->loop_reps))
     {
-        if (pulse_timer_ms >= on_ms)
+        c->seg -= sg->loop_back;
+        if (c->wave->period_step)
         {
-            pwm_stop();
-            pulse_on = false;
-            pulse_timer_ms = 0;
+            // Sweep: next carrier period, and the duty scale that keeps the level
+            c->period = (uint16_t)(c->period + c->wave->period_step);
+            c->scale = (uint32_t)((int32_t)c->scale + c->wave->scale_step);
         }
     }
     else
     {
-        if (pulse_timer_ms >= off_ms)
+        if (sg->loop_reps)
+        {
+            c->loops = 0; // loop done
+        }
+        if (++c->seg >= c->wave->count)
         {
-            pwm_start(active_pod, 50); // re-enable PWM at nominal freq
-            pulse_on = true;
-            pulse_timer_ms = 0;
+            channel_end(ch);
+            if (!c->gap_ms)
+            {
+                seq_start_next(ch); // back to back: next step at the same instant
+            }
+            if (c->pod == 0xFF)
+            {
+                channel_release(ch); // kept closed only for the same pod
+            }
+            return;
         }
     }
+    wave_enter(ch);
+}
 
-    // Duration countdown
-    if (pulse_duration_ms)
+// ms until the channel's next event, 0 if it has none
+static uint16_t channel_next_ms(const relay_channel_t *c)
+{
+    uint16_t next = c->relay_ms;
+    uint16_t n = channel_driving(c) ? c->seg_left_ms : ((c->pod == 0xFF) ? c->gap_ms : 0);
+    if (n && (!next || n < next))
     {
-        if (pulse_duration_ms > 1)
+        next = n;
+    }
+    return next;
+}
+
+// Move a channel forward by ms, handling every event on the way. The relay
+// wait runs alongside a sequencer gap.
+static void channel_advance(uint8_t ch, uint16_t ms)
+{
+    relay_channel_t *c = &channels[ch];
+
+    for (;;)
+    {
+        uint16_t next = channel_next_ms(c);
+        if (!next)
         {
-            pulse_duration_ms--;
+            if (c->pod != 0xFF || c->tail == c->head)
+            {
+                return; // nothing queued: idle
+            }
+            seq_start_next(ch);
+            continue;
         }
-        else
+
+        uint16_t step = (ms < next) ? ms : next;
+        bool driving = channel_driving(c);
+        bool relay_due = false;
+        if (driving)
+        {
+            // Charge the elapsed time to the pod at the level actually driven
+            pod_dose[c->pod] += ((uint32_t)c->level * step) >> 8;
+            c->seg_left_ms -= step;
+        }
+        else if (c->pod == 0xFF && c->gap_ms)
+        {
+            c->gap_ms -= step;
+        }
+        if (c->relay_ms)
+        {
+            c->relay_ms -= step;
+            relay_due = !c->relay_ms;
+        }
+        ms -= step;
+        if (step < next)
+        {
+            return;
+        }
+
+        if (relay_due)
+        {
+            relay_ready(ch);
+        }
+        if (driving && !c->seg_left_ms)
+        {
+            segment_end(ch);
+        }
+        else if (c->pod == 0xFF && !c->gap_ms)
         {
-            relay_pwm_stop();
+            seq_start_next(ch);
         }
     }
 }
+
+// Program Timer4 for the nearest event, or stop it. TMR4 may hold the
+// part of a millisecond already elapsed, which counts towards the span.
+static void timer_schedule(void)
+{
+    uint16_t next = 0;
+    for (uint8_t ch = 0; ch < RELAY_CHANNEL_COUNT; ch++)
+    {
+        uint16_t n = channel_next_ms(&channels[ch]);
+        if (n && (!next || n < next))
+        {
+            next = n;
+        }
+    }
+
+    if (!next)
+    {
+        T4CONbits.TON = 0;
+        TMR4 = 0;
+        t4_span_ms = 0;
+        return;
+    }
+    if (next > RELAY_SPAN_MAX_MS)
+    {
+        next = RELAY_SPAN_MAX_MS;
+    }
+    t4_span_ms = next;
+    PR4 = (uint16_t)(next * RELAY_TICKS_PER_MS - 1u);
+    T4CONbits.TON = 1;
+}
+
+// Bring the channels up to date mid-span before the caller changes them
+static void timer_sync(void)
+{
+    if (!t4_span_ms)
+    {
+        return;
+    }
+    // A period match while interrupts are masked restarts TMR4 from 0 and
+    // means the whole span is over too. Take it here rather than leave the
+    // ISR to count it against the period set up below. The flag is sampled
+    // before TMR4 and again after it, so a match landing between the two
+    // reads is seen with the restarted count, never with the old one.
+    bool matched = IFS1bits.T4IF;
+    uint16_t ticks = TMR4;
+    if (!matched && IFS1bits.T4IF)
+    {
+        matched = true;
+        ticks = TMR4;
+    }
+    uint16_t ms = ticks / RELAY_TICKS_PER_MS;
+    uint16_t left = ticks - ms * RELAY_TICKS_PER_MS;
+    if (matched)
+    {
+        IFS1bits.T4IF = 0;
+        ms += t4_span_ms;
+    }
+    if (!ms)
+    {
+        return;
+    }
+    TMR4 = left;
+    for (uint8_t ch = 0; ch < RELAY_CHANNEL_COUNT; ch++)
+    {
+        channel_advance(ch, ms);
+    }
+}
+
+// ------------------------------------------------------------
+// Fire a pod's relay with a PWM waveform (leaves the other side alone)
+// ------------------------------------------------------------
+bool relay_pwm_fire_envelope(uint8_t pod_index, uint16_t duration_ms, const relay_envelope_t *env)
+{
+    if (pod_index >= 6 || !env)
+    {
+        return false;
+    }
+    relay_wave_t w;
+    uint16_t ipl;
+
+    wave_compile(&w, duration_ms, env);
+    if (!w.count)
+    {
+        return false;
+    }
+
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    timer_sync();
+    channel_fire_own(relay_pwm_channel(pod_index), pod_index, &w, &pod_plan[pod_index]);
+    timer_schedule();
+    RESTORE_CPU_IPL(ipl);
+    return true;
+}
+
+bool relay_pwm_compile(relay_wave_t *w, uint16_t duration_ms, uint16_t level)
+{
+    if (!w)
+    {
+        return false;
+    }
+    relay_envelope_t env;
+    legacy_fire_envelope(&env, level);
+    wave_compile(w, duration_ms, &env);
+    return w->count != 0;
+}
+
+bool relay_pwm_start(uint8_t pod_index, const relay_wave_t *w)
+{
+    if (pod_index >= 6 || !w || !w->count)
+    {
+        return false;
+    }
+    uint8_t ch = relay_pwm_channel(pod_index);
+    uint16_t ipl;
+
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    timer_sync();
+    seq_release(&channels[ch]);
+    channel_fire(ch, pod_index, w, &pod_plan[pod_index]); // plays w in place
+    timer_schedule();
+    RESTORE_CPU_IPL(ipl);
+    return true;
+}
+
+bool relay_pwm_wave_busy(const relay_wave_t *w)
+{
+    for (uint8_t ch = 0; ch < RELAY_CHANNEL_COUNT; ch++)
+    {
+        if (channels[ch].pod != 0xFF && channels[ch].wave == w)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Legacy pulse pattern: on for intensity * 10 ms out of every second, at
+// the duty for intensity
+void relay_pwm_fire(uint8_t pod_index, uint16_t duration_ms, uint8_t intensity)
+{
+    relay_envelope_t env;
+    legacy_fire_envelope(&env, RELAY_LEVEL(intensity));
+    (void)relay_pwm_fire_envelope(pod_index, duration_ms, &env);
+}
+
+// ------------------------------------------------------------
+// Carrier planner, per-pod carrier and calibration sweep
+// ------------------------------------------------------------
+bool relay_pwm_plan_period(uint16_t period, uint8_t tmrps, relay_plan_t *plan)
+{
+    bool ok = (period >= RELAY_PERIOD_MIN && period <= RELAY_PERIOD_MAX);
+    if (!ok)
+    {
+        period = FREQ_DEFAULT;
+        tmrps = 0;
+    }
+    plan->period = period;
+    plan->tmrps = (tmrps < sizeof(RELAY_PRESCALE_SHIFT)) ? tmrps : 0;
+    plan->scale = ((uint32_t)period << 16) / RELAY_DUTY_FULL_SCALE;
+    return ok;
+}
+
+bool relay_pwm_plan(uint32_t freq_hz, relay_plan_t *plan)
+{
+    if (!freq_hz)
+    {
+        return false;
+    }
+    for (uint8_t ps = 0; ps < sizeof(RELAY_PRESCALE_SHIFT); ps++)
+    {
+        // Nearest whole count; CCPxPRL holds the period minus one
+        uint32_t counts = ((FCY >> RELAY_PRESCALE_SHIFT[ps]) + freq_hz / 2u) / freq_hz;
+        if (counts <= RELAY_PERIOD_MIN)
+        {
+            return false; // too fast for Tcy
+        }
+        if (counts - 1u <= RELAY_PERIOD_MAX)
+        {
+            (void)relay_pwm_plan_period((uint16_t)(counts - 1u), ps, plan);
+            return true;
+        }
+    }
+    return false; // too slow even at 1:64
+}
+
+static void pod_plan_set(uint8_t pod_index, const relay_plan_t *plan)
+{
+    uint16_t ipl;
+    SET_AND_SAVE_CPU_IPL(ipl, 7); // the sequencer reads it from the ISR
+    pod_plan[pod_index] = *plan;  // picked up by the pod's next fire
+    RESTORE_CPU_IPL(ipl);
+}
+
+void relay_pwm_set_carrier(uint8_t pod_index, uint16_t period, uint8_t tmrps)
+{
+    if (pod_index >= 6)
+    {
+        return;
+    }
+    relay_plan_t plan;
+    (void)relay_pwm_plan_period(period, tmrps, &plan); // RELAY_PERIOD_DEFAULT or out of range: default
+    pod_plan_set(pod_index, &plan);
+}
+
+bool relay_pwm_sweep(uint8_t pod_index, const relay_sweep_t *sweep)
+{
+    if (pod_index >= 6 || !sweep || !sweep->step_ms || !sweep->period_step)
+    {
+        return false;
+    }
+    uint16_t from = sweep->period_from;
+    uint16_t to = sweep->period_to;
+    if (from < RELAY_PERIOD_MIN || from > RELAY_PERIOD_MAX || to < RELAY_PERIOD_MIN || to > RELAY_PERIOD_MAX ||
+        sweep->period_step > 0x7FFF)
+    {
+        return false;
+    }
+    uint16_t span = (to > from) ? (uint16_t)(to - from) : (uint16_t)(from - to);
+    uint16_t steps = span / sweep->period_step + 1u;
+    if (steps >= RELAY_LOOP_FOREVER)
+    {
+        return false;
+    }
+
+    // One continuous segment, looped once per period step
+    relay_envelope_t env = {RELAY_LEVEL(sweep->intensity), 0, 0, 0, 0};
+    relay_plan_t plan;
+    relay_wave_t w;
+    uint16_t ipl;
+
+    (void)relay_pwm_plan_period(from, 0, &plan);
+    wave_compile(&w, sweep->step_ms, &env);
+    if (w.count != 1)
+    {
+        return false;
+    }
+    w.period_step = (to >= from) ? (int16_t)sweep->period_step : (int16_t)-(int16_t)sweep->period_step;
+    w.scale_step = ((int32_t)w.period_step * 65536L) / (int32_t)RELAY_DUTY_FULL_SCALE;
+    wave_loop(&w, 0, steps);
+
+    uint8_t ch = relay_pwm_channel(pod_index);
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    timer_sync();
+    channel_fire_own(ch, pod_index, &w, &plan);
+    channels[ch].sweeping = true;
+    timer_schedule();
+    RESTORE_CPU_IPL(ipl);
+    return true;
+}
+
+bool relay_pwm_sweep_pick(uint8_t pod_index, uint16_t *period)
+{
+    if (pod_index >= 6 || !period)
+    {
+        return false;
+    }
+    relay_channel_t *c = &channels[relay_pwm_channel(pod_index)];
+    bool picked = false;
+    uint16_t ipl;
+
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    timer_sync();
+    if (c->sweeping && c->pod == pod_index)
+    {
+        *period = c->period;
+        channel_stop(relay_pwm_channel(pod_index));
+        picked = true;
+    }
+    timer_schedule();
+    RESTORE_CPU_IPL(ipl);
+    return picked;
+}
+
+uint16_t relay_pwm_period_now(uint8_t channel)
+{
+    if (channel >= RELAY_CHANNEL_COUNT || channels[channel].pod == 0xFF)
+    {
+        return 0;
+    }
+    return channels[channel].period;
+}
+
+void relay_pwm_stop_channel(uint8_t channel)
+{
+    if (channel >= RELAY_CHANNEL_COUNT)
+    {
+        return;
+    }
+    uint16_t ipl;
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    timer_sync();
+    channel_stop(channel);
+    timer_schedule();
+    RESTORE_CPU_IPL(ipl);
+}
+
+void relay_pwm_stop(void)
+{
+    uint16_t ipl;
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    timer_sync();
+    for (uint8_t ch = 0; ch < RELAY_CHANNEL_COUNT; ch++)
+    {
+        channel_stop(ch);
+    }
+    all_relays_off();
+    timer_schedule();
+    RESTORE_CPU_IPL(ipl);
+}
+
+void relay_pwm_set_relay_timing(uint16_t dead_ms, uint16_t settle_ms)
+{
+    uint16_t ipl;
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    relay_dead_ms = dead_ms; // waits already running keep their length
+    relay_settle_ms = settle_ms;
+    RESTORE_CPU_IPL(ipl);
+}
+
+// ------------------------------------------------------------
+// Sequencer (one queue per channel)
+// ------------------------------------------------------------
+void relay_pwm_set_resolver(relay_resolve_cb_t cb, void *ctx)
+{
+    uint16_t ipl;
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    seq_resolve = cb;
+    seq_resolve_ctx = ctx;
+    RESTORE_CPU_IPL(ipl);
+}
+
+bool relay_pwm_queue(uint8_t channel, const relay_step_t *step)
+{
+    if (channel >= RELAY_CHANNEL_COUNT || !step)
+    {
+        return false;
+    }
+    if (step->pod != RELAY_POD_SCENT && (step->pod >= 6 || relay_pwm_channel(step->pod) != channel))
+    {
+        return false;
+    }
+    relay_channel_t *c = &channels[channel];
+    uint8_t next = seq_advance(c->head);
+    if (next == c->tail)
+    {
+        return false;
+    }
+    relay_queued_t *q = &c->queue[c->head];
+    q->step = *step;
+    q->wave.count = 0;
+    if (step->duration_ms)
+    {
+        relay_envelope_t env;
+        legacy_fire_envelope(&env, RELAY_LEVEL(step->intensity));
+        wave_compile(&q->wave, step->duration_ms, &env);
+    }
+    c->head = next; // publish only once the step is compiled
+
+    // An idle channel has no timer event to pick the step up: start it now
+    uint16_t ipl;
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    if (c->pod == 0xFF && !c->gap_ms)
+    {
+        timer_sync();
+        seq_start_next(channel);
+        timer_schedule();
+    }
+    RESTORE_CPU_IPL(ipl);
+    return true;
+}
+
+bool relay_pwm_seq_idle(uint8_t channel)
+{
+    if (channel >= RELAY_CHANNEL_COUNT)
+    {
+        return false;
+    }
+    const relay_channel_t *c = &channels[channel];
+    return c->head == c->tail && c->pod == 0xFF && !c->gap_ms;
+}
+
+void relay_pwm_seq_flush(uint8_t channel)
+{
+    if (channel >= RELAY_CHANNEL_COUNT)
+    {
+        return;
+    }
+    relay_channel_t *c = &channels[channel];
+    uint16_t ipl;
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    timer_sync();
+    if (c->seq_playing)
+    {
+        c->head = seq_advance(c->tail); // the playing step finishes
+    }
+    else
+    {
+        c->tail = c->head;
+    }
+    c->gap_ms = 0;
+    timer_schedule();
+    RESTORE_CPU_IPL(ipl);
+}
+
+// ------------------------------------------------------------
+// Dose drained since the last call (intensity*ms of PWM on-time)
+// ------------------------------------------------------------
+uint32_t relay_pwm_take_dose(uint8_t pod_index)
+{
+    uint32_t dose;
+    uint16_t ipl;
+
+    if (pod_index >= 6)
+    {
+        return 0;
+    }
+
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    dose = pod_dose[pod_index];
+    pod_dose[pod_index] = 0;
+    RESTORE_CPU_IPL(ipl);
+    return dose;
+}
+
+uint16_t relay_pwm_take_fires(uint8_t pod_index)
+{
+    uint16_t fires;
+    uint16_t ipl;
+
+    if (pod_index >= 6)
+    {
+        return 0;
+    }
+
+    SET_AND_SAVE_CPU_IPL(ipl, 7);
+    fires = pod_fires[pod_index];
+    pod_fires[pod_index] = 0;
+    RESTORE_CPU_IPL(ipl);
+    return fires;
+}
+
+// ------------------------------------------------------------
+// Timer4 ISR: one interrupt per waveform event, none while idle
+// ------------------------------------------------------------
+void __attribute__((interrupt, no_auto_psv)) _T4Interrupt(void)
+{
+    IFS1bits.T4IF = 0;
+
+    uint16_t elapsed = t4_span_ms; // TMR4 restarted from 0 on the match
+    for (uint8_t ch = 0; ch < RELAY_CHANNEL_COUNT; ch++)
+    {
+        channel_advance(ch, elapsed);
+    }
+    timer_schedule();
+}
@@ -17,8 +17,181 @@
 #include <xc.h>
 #include <libpic30.h>
 
+// Independent PWM channels: RIGHT = MCCP2 (pods 0-2), LEFT = MCCP3 (pods 3-5)
+#define RELAY_CHANNEL_RIGHT 0
+#define RELAY_CHANNEL_LEFT 1
+#define RELAY_CHANNEL_COUNT 2
+#define RELAY_PODS_PER_CHANNEL 3
+
+static inline uint8_t relay_pwm_channel(uint8_t pod_index)
+{
+    return (pod_index < RELAY_PODS_PER_CHANNEL) ? RELAY_CHANNEL_RIGHT : RELAY_CHANNEL_LEFT;
+}
+
+// Relay contact timing for break-before-make switching (check the relay
+// datasheet: release time, operate time plus bounce)
+#define RELAY_DEAD_MS_DEFAULT 5
+#define RELAY_SETTLE_MS_DEFAULT 10
+
+// Intensity scale, as in the original driver: duty = intensity / 144, so
+// 144 is a 100 % duty and values above it are clamped to it. The legacy
+// relay_pwm_fire pulse runs continuously from 100 up.
+#define RELAY_INTENSITY_MAX 144
+
+// Fine intensity: Q8 intensity points (RELAY_LEVEL(i) for whole points),
+// used by envelopes and compiled fires. The duty resolution is then the
+// carrier's own, period + 1 counts, where whole points capped it at 145
+// steps: a 16 kHz carrier (1000 counts) gets 1001 duty steps instead of
+// 145, and every prescaled plan gains likewise. At the 172 kHz default
+// (93 counts of Tcy) the carrier is the limit and it stays at 94 steps.
+#define RELAY_LEVEL(intensity) ((uint16_t)((uint16_t)(intensity) << 8))
+#define RELAY_LEVEL_MAX RELAY_LEVEL(RELAY_INTENSITY_MAX)
+
+// Waveform table limits: ramp up + pulse pair + cut-short period + ramp down
+#define RELAY_RAMP_STEPS 4
+#define RELAY_SEG_MAX (2 * RELAY_RAMP_STEPS + 4)
+
+/**
+ * Fire envelope, compiled into a segment table when the fire starts:
+ * ramp from 0 to level, then hold (on_ms or off_ms == 0) or a pulse
+ * train of on_ms at level / off_ms off, then ramp back down over
+ * tail_ms. Ramp and tail are part of the fire duration.
+ */
+typedef struct
+{
+    uint16_t level; // Q8 intensity, 0-RELAY_LEVEL_MAX
+    uint16_t ramp_ms;
+    uint16_t on_ms;
+    uint16_t off_ms;
+    uint16_t tail_ms;
+} relay_envelope_t;
+
+// Waveform segment: hold one PWM level for ms, then move on. With
+// loop_reps set the segment jumps back loop_back entries until it has run
+// loop_reps times (RELAY_LOOP_FOREVER: until the fire is stopped).
+typedef struct
+{
+    uint16_t ms;
+    uint16_t level;     // Q8 intensity driven, 0 = output off
+    uint16_t charge;    // Q8 intensity charged for dose accounting
+    uint8_t loop_back;
+    bool gated;         // carrier gated by the hardware pulse envelope
+    uint16_t loop_reps;
+} relay_seg_t;
+
+#define RELAY_LOOP_FOREVER 0xFFFF
+
+/**
+ * Compiled fire: a segment table stepped by the Timer4 ISR. Built in the
+ * caller's context (relay_pwm_compile) so starting it from an ISR is only
+ * a table load; the contents are private to the relay manager.
+ */
+typedef struct
+{
+    relay_seg_t seg[RELAY_SEG_MAX];
+    uint8_t count;
+    int16_t period_step; // added to the period on every loop pass (sweeps)
+    int32_t scale_step;  // and the matching relay_plan_t.scale change
+    uint16_t env_on;     // envelope on-time in envelope ticks (gated segments)
+    uint16_t env_period; // envelope period in envelope ticks
+} relay_wave_t;
+
+// Carrier period in MCCP counts (Tcy / period), per pod. Same convention as
+// the pod record: 0xFFFF selects the board default.
+#define RELAY_PERIOD_DEFAULT 0xFFFF
+
+/**
+ * Carrier plan: MCCP prescaler and period for a frequency, plus the duty
+ * per intensity point in Q16 (period / 144 * 65536). Worked out once when
+ * a pod's carrier is set so fires only multiply and shift.
+ */
+typedef struct
+{
+    uint16_t period; // CCPxPRL
+    uint8_t tmrps;   // CCPxCON1L.TMRPS
+    uint32_t scale;  // Q16 duty counts per intensity point
+} relay_plan_t;
+
+/**
+ * Calibration sweep: the carrier runs continuously at intensity and steps
+ * from period_from towards period_to by period_step every step_ms, ending
+ * after the step that reaches (or would pass) period_to. Periods are 1:1
+ * counts.
+ */
+typedef struct
+{
+    uint8_t intensity;
+    uint16_t period_from;
+    uint16_t period_to;
+    uint16_t period_step;
+    uint16_t step_ms;
+} relay_sweep_t;
+
+// Fire program queue per channel, played back-to-back by the Timer4 ISR.
+// Steps are compiled when queued; holds RELAY_SEQ_DEPTH - 1 including the
+// one playing.
+#define RELAY_SEQ_DEPTH 8
+#define RELAY_POD_SCENT 0xFE // relay_step_t.pod: pick the pod for .scent at step start
+
+typedef struct
+{
+    uint8_t pod;          // pod index 0-5, or RELAY_POD_SCENT
+    uint8_t intensity;
+    uint16_t scent;       // only used with RELAY_POD_SCENT
+    uint16_t duration_ms;
+    uint16_t gap_ms;      // silence after the step before the next one starts
+} relay_step_t;
+
+// Maps a scent to a pod index on channel (0xFF if none can fire). Called
+// from the ISR.
+typedef uint8_t (*relay_resolve_cb_t)(void *ctx, uint16_t scent, uint8_t channel);
+
 void relay_pwm_init(void);
+// Fires on the pod's channel only; a fire already running there is replaced
+// duration_ms 0 runs until stopped
 void relay_pwm_fire(uint8_t pod_index, uint16_t duration_ms, uint8_t intensity);
-void relay_pwm_stop(void);
+bool relay_pwm_fire_envelope(uint8_t pod_index, uint16_t duration_ms, const relay_envelope_t *env);
+// The same fire split in two: compile relay_pwm_fire's pattern, at a Q8
+// level (RELAY_LEVEL), in the caller's context, then start it from anywhere, ISRs included, for the
+// cost of a table load. The table plays in place, so leave it untouched
+// while relay_pwm_wave_busy says so (check with interrupts masked).
+bool relay_pwm_compile(relay_wave_t *w, uint16_t duration_ms, uint16_t level);
+bool relay_pwm_start(uint8_t pod_index, const relay_wave_t *w);
+bool relay_pwm_wave_busy(const relay_wave_t *w);
+void relay_pwm_stop_channel(uint8_t channel);
+void relay_pwm_stop(void); // both channels
+// Dead time: a channel's relays all open before the next one closes.
+// Settle: relay closed before the PWM starts. Fires start late by up to
+// both; a fire on the pod whose relay is still closed (back-to-back
+// sequencer steps, a replaced fire) skips them.
+void relay_pwm_set_relay_timing(uint16_t dead_ms, uint16_t settle_ms);
+
+// Finest prescaler/period for freq_hz; false if out of reach
+bool relay_pwm_plan(uint32_t freq_hz, relay_plan_t *plan);
+// Plan for a period in counts of prescaler tmrps (0-3, anything else is
+// 1:1); false (and the default) if the period is out of range
+bool relay_pwm_plan_period(uint16_t period, uint8_t tmrps, relay_plan_t *plan);
+// Carrier used by the pod's next fire (a running one keeps its own), as
+// planned by relay_pwm_plan and kept in the pod record
+void relay_pwm_set_carrier(uint8_t pod_index, uint16_t period, uint8_t tmrps);
+// Replaces any fire on the pod's channel; stop it like any other fire
+bool relay_pwm_sweep(uint8_t pod_index, const relay_sweep_t *sweep);
+// Stops the pod's sweep and returns the period it had reached; false, and
+// nothing stopped, unless that sweep is what the channel is running
+bool relay_pwm_sweep_pick(uint8_t pod_index, uint16_t *period);
+uint16_t relay_pwm_period_now(uint8_t channel); // 0 while the channel is idle
+
+void relay_pwm_set_resolver(relay_resolve_cb_t cb, void *ctx);
+// false if the queue is full or step.pod is not on channel
+bool relay_pwm_queue(uint8_t channel, const relay_step_t *step);
+bool relay_pwm_seq_idle(uint8_t channel);  // nothing queued or playing
+void relay_pwm_seq_flush(uint8_t channel); // drop queued steps; a playing one finishes
+
+// Returns and clears the PWM on-time accumulated for a pod, in units of
+// intensity * ms (a 1 s fire at intensity 50 adds 50000)
+uint32_t relay_pwm_take_dose(uint8_t pod_index);
+// Returns and clears the number of fires started on a pod (direct, queued
+// and sweeps alike)
+uint16_t relay_pwm_take_fires(uint8_t pod_index);
 
 #endif